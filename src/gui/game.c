@@ -34,6 +34,7 @@
 #include "raylib.h"
 
 #include <ndjin/bb.h>
+#include <ndjin/eval.h>
 #include <ndjin/types.h>
 
 #include "game.h"
@@ -220,12 +221,8 @@ struct square_t get_square(struct game_t *data, struct state_t *state, int x,
     int sq                 = 0;
     sq                     = ((7 - j) * 8) + i;
     struct square_t square = {-1, sq};
-    for (int x = 0; x < 12; ++x) {
-        if ((1ULL << sq) & state->bitboards[x]) {
-            square.piece = x;
-            break;
-        }
-    }
+    if (sq >= a1 && sq <= h8)
+        square.piece = state->board[sq];
     return square;
 }
 
@@ -251,7 +248,7 @@ void update_input(struct game_t *data, struct move_list_t *list)
             (sq.piece >= 6 && data->game_state->side == white))
             goto draw_floating;
 
-        possibles      = list->squares[sq.square];
+        square_moves(list, sq.square, &possibles);
         floating_piece = sq.piece;
         original_sqr   = sq;
     } else if (IsMouseButtonReleased(MOUSE_LEFT_BUTTON)) {
@@ -298,11 +295,12 @@ char score_white[16] = {0};
 char score_black[16] = {0};
 void draw_move_scores(struct game_t *data, struct move_list_t *list)
 {
-    double eval = symmetric_eval(data->game_state, list);
+    /* centipawns, shown in pawns */
+    int eval = symmetric_eval(data->game_state, list);
     if (data->game_state->side == white)
-        snprintf(score_white, 16, "%02f", eval);
+        snprintf(score_white, 16, "%.2f", eval / 100.0);
     else
-        snprintf(score_black, 16, "%02f", eval);
+        snprintf(score_black, 16, "%.2f", eval / 100.0);
     DrawText(score_white, 230, 610, 20, LIGHTGRAY);
     DrawText(score_black, 230, 10, 20, LIGHTGRAY);
 }
@@ -99,7 +99,7 @@ int main(int argc, char **argv)
     data.game_state                    = &state;
 
     parse_fen(START_BOARD, &state);
-    generate_moves(&state, &available_moves);
+    generate_moves(&state, &available_moves, all_moves);
 
     InitWindow(win_width, win_height, "ndjin [chess]");
     SetTargetFPS(60);
@@ -107,7 +107,7 @@ int main(int argc, char **argv)
     load_assets();
 
     char code[16] = {0};
-    u64  nstate, pstate = state.positions[2];
+    u64  nstate, pstate = state.hash;
 
     enum { no_opponent, manual_play, bot_play };
 
@@ -172,11 +172,11 @@ int main(int argc, char **argv)
         /* --- END: New Game Lobby --- */
         case game_play:
             /* --- START: Game Screen --- */
-            if ((nstate = state.positions[2]) != pstate) {
+            if ((nstate = state.hash) != pstate) {
                 pstate = nstate;
                 fprintf(stderr, "generate_moves(): state changed, "
                                 "generating moveset\n");
-                generate_moves(&state, &available_moves);
+                generate_moves(&state, &available_moves, all_moves);
             }
             update_input(&data, &available_moves);
 
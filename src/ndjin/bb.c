@@ -28,12 +28,24 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <assert.h>
 #include <stdio.h>
 #include <string.h>
-#include <sys/time.h>
+#include <time.h>
+
+#ifdef USE_PEXT
+#ifndef __BMI2__
+#error "USE_PEXT requires a BMI2 target (-mbmi2)"
+#endif
+#include <immintrin.h>
+#endif
 
 #include "types.h"
 #include "bb.h"
+#include "bitops.h"
+#include "eval.h"
+#include "tt.h"
+#include "zobrist.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 //                                 Extern                                     //
@@ -46,6 +58,40 @@ extern const char  promoted_pieces[];
 extern const int   char_pieces[];
 extern const char  piece_char[];
 
+////////////////////////////////////////////////////////////////////////////////
+//                                 Static                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+static inline void print_tiles(void);
+static inline void print_bitboard(u64 bitboard);
+static inline void print_attacked(struct state_t *state, int side);
+static inline void print_board(struct state_t *state, int unicode);
+static inline void print_move(unsigned int move, int unicode);
+static inline void print_move_list(struct move_list_t *moves, int unicode);
+
+static inline u64 mask_pawn_attacks(int square, int side);
+static inline u64 mask_knight_attacks(int square);
+static inline u64 mask_king_attacks(int square);
+static inline u64 mask_bishop_attacks(int square);
+static inline u64 mask_rook_attacks(int square);
+static inline u64 generate_bishop_attacks(int square, u64 block);
+static inline u64 generate_rook_attacks(int square, u64 block);
+static inline u64 get_bishop_attacks(int square, u64 position);
+static inline u64 get_rook_attacks(int square, u64 position);
+static inline u64 get_queen_attacks(int square, u64 position);
+
+static inline void init_slider_attacks(int piece, struct magic_t *tables,
+                                       u64 *slider);
+static inline void init_line_tables(u64 between[64][64], u64 line[64][64]);
+
+static inline int count_bits(u64 bitboard);
+static inline int get_lsb_index(u64 bitboard);
+static inline u64 set_positions(int idx, int mask_bit_count, u64 attack_mask);
+
+static inline u64 xorshift64(void);
+static inline u64 rand_u64(void);
+static inline u64 find_magic(int square, int m, int piece);
+
 ////////////////////////////////////////////////////////////////////////////////
 //                                 Board                                      //
 ////////////////////////////////////////////////////////////////////////////////
@@ -164,25 +210,25 @@ int stopped = 0;
 //                                 Functions                                  //
 ////////////////////////////////////////////////////////////////////////////////
 
-int get_time_ms(void)
+/* Milliseconds on a clock that only moves forward, wall clock adjustments
+ * never make a search think it has run over or has time to spare.
+ */
+u64 get_time_ms(void)
 {
-    struct timeval time_value;
-    gettimeofday(&time_value, NULL);
-    return time_value.tv_sec * 1000 + time_value.tv_usec / 1000;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ( u64 )ts.tv_sec * 1000 + ( u64 )ts.tv_nsec / 1000000;
 }
 
 static inline int count_bits(u64 bitboard)
 {
-    unsigned int count = 0;
-    for (count = 0; bitboard; ++count)
-        bitboard &= bitboard - 1;
-    return count;
+    return bit_count(bitboard);
 }
 
 static inline int get_lsb_index(u64 bitboard)
 {
     if (bitboard)
-        return count_bits((bitboard & -bitboard) - 1);
+        return bit_lsb(bitboard);
     else
         return -1;
 }
@@ -241,11 +287,7 @@ static inline void print_board(struct state_t *state, int unicode)
     for (int i = 7; i >= 0; --i) {
         for (int j = 0; j < 8; ++j) {
             int sq    = (i * 8) + j;
-            int piece = -1;
-            for (int k = 0; k < 12; ++k) {
-                if (get_bit(state->bitboards[k], sq) > 0)
-                    piece = k;
-            }
+            int piece = state->board[sq];
             if (!j)
                 printf("  %d ", i + 1);
             if (!unicode)
@@ -287,9 +329,8 @@ static inline void print_move(unsigned int move, int unicode)
 static inline void print_move_list(struct move_list_t *moves, int unicode)
 {
     printf("\nmove    piece (-> promo.) \tcapture double en-pass. castle\n");
-    for (int i = 0; i < 64; ++i)
-        for (int j = 0; j < moves->squares[i].count; ++j)
-            print_move(moves->squares[i].moves[j], unicode);
+    for (int i = 0; i < moves->count; ++i)
+        print_move(moves->moves[i], unicode);
     printf("Total move count: \t%d\n", moves->count);
 }
 
@@ -481,15 +522,21 @@ const u64 king_attacks[64] = {
         11592265440851656704ULL,        4665729213955833856ULL,
 };
 
-u64 bishop_masks[64];
-
-u64 rook_masks[64];
-
-u64 bishop_attacks[64][512]; /* [square][positions] */
-
-u64 rook_attacks[64][4096]; /* [square][positions] */
 /* clang-format on */
 
+/* bishop_table[], rook_table[] and slider_attacks[] are const data in the
+ * generated slider_tables.c, see init_slider_attacks() and `make
+ * slider_tables`. The generator itself links against these empty stand-ins.
+ */
+#ifdef _SLIDER_GEN
+const struct magic_t bishop_table[64];
+const struct magic_t rook_table[64];
+const u64            slider_attacks[SLIDER_ATTACKS_SIZE];
+const u64            slider_tables_checksum;
+const u64            between_squares[64][64];
+const u64            line_squares[64][64];
+#endif
+
 static inline u64 mask_pawn_attacks(int square, int side)
 {
     u64 attacks  = 0ULL;
@@ -691,7 +738,7 @@ static inline u64 set_positions(int idx, int bit_count, u64 mask)
 
     for (int i = 0; i < bit_count; ++i) {
         int square = get_lsb_index(mask);
-        pop_bit(mask, square);
+        pop_lsb(mask);
         if (idx & (1 << i))
             positions |= (1ULL << square);
     }
@@ -797,10 +844,14 @@ const u64 rook_magics[64] = {
 };
 /* clang-format on */
 
-u64 seed[] = {
+/* per thread so magic_finder workers each walk their own sequence */
+_Thread_local u64 seed[] = {
         8392127718274466268ULL,
 };
 
+/* attempts find_magic() makes before giving up */
+long magic_tries = 100000000;
+
 static inline u64 xorshift64(void)
 {
     u64 x  = *seed;
@@ -830,12 +881,16 @@ static inline u64 rand_bits(int n)
     return r;
 }
 
+/* bits may be lower than the mask's bit count, in which case only magics
+ * whose colliding positions share an attack set are accepted
+ */
 static inline u64 find_magic(int square, int bits, int piece)
 {
     u64 mask, magic = 0;
     u64 positions[4096]    = {0ULL};
     u64 attacks[4096]      = {0ULL};
     u64 used_attacks[4096] = {0ULL};
+    int used_epoch[4096]   = {0};
 
     if (piece != bishop && piece != rook)
         return 0ULL;
@@ -843,25 +898,28 @@ static inline u64 find_magic(int square, int bits, int piece)
     mask                 = (piece == bishop ? mask_bishop_attacks(square)
                                             : mask_rook_attacks(square));
 
-    int position_indexes = 1 << bits;
+    int mask_bits        = count_bits(mask);
+    int position_indexes = 1 << mask_bits;
 
     for (int i = 0; i < position_indexes; ++i) {
-        positions[i] = set_positions(i, bits, mask);
+        positions[i] = set_positions(i, mask_bits, mask);
         attacks[i] =
                 (piece == bishop ? generate_bishop_attacks(square, positions[i])
                                  : generate_rook_attacks(square, positions[i]));
     }
 
-    for (int i = 0; i < 100000000; ++i) {
+    for (long i = 1; i <= magic_tries; ++i) {
         magic = rand_bits(3);
         if (count_bits((mask * magic) & 0xFF00000000000000ULL) < 6)
             continue;
-        memset(used_attacks, 0ULL, sizeof(u64) * 4096);
 
-        int fail = 0;
+        /* epochs stand in for clearing used_attacks[] on every attempt */
+        int epoch = ( int )(i & 0x7FFFFFFF);
+        int fail  = 0;
         for (int index = 0; index < position_indexes; ++index) {
             int magic_idx = ( int )((positions[index] * magic) >> (64 - bits));
-            if (used_attacks[magic_idx] == 0ULL) {
+            if (used_epoch[magic_idx] != epoch) {
+                used_epoch[magic_idx]   = epoch;
                 used_attacks[magic_idx] = attacks[index];
             } else if (used_attacks[magic_idx] != attacks[index]) {
                 fail = 1;
@@ -877,78 +935,145 @@ static inline u64 find_magic(int square, int bits, int piece)
     return 0ULL;
 }
 
-static inline void init_slider_attacks(int piece)
+static inline u64 slider_index(const struct magic_t *table, u64 position)
+{
+#ifdef USE_PEXT
+    return _pext_u64(position, table->mask);
+#else
+    return ((position & table->mask) * table->magic) >> table->shift;
+#endif
+}
+
+/* Every bishop and rook square owns a slice of slider, bishops first. Magic
+ * squares can be given fewer index bits than their mask has (constructive
+ * collisions), PEXT squares always use exactly the mask bits.
+ */
+static inline void init_slider_attacks(int piece, struct magic_t *tables,
+                                       u64 *slider)
 {
     if (piece != bishop && piece != rook)
         return;
 
+    u64 *attacks = slider + (piece == bishop ? 0 : BISHOP_ATTACKS_SIZE);
+
     for (int i = 0; i < 64; ++i) {
-        bishop_masks[i] = mask_bishop_attacks(i);
-        rook_masks[i]   = mask_rook_attacks(i);
+        struct magic_t *table = &tables[i];
+
+        table->mask      = (piece == bishop ? mask_bishop_attacks(i)
+                                            : mask_rook_attacks(i));
+        table->magic     = (piece == bishop ? bishop_magics[i] : rook_magics[i]);
+        table->attacks   = attacks;
+
+        int mask_bits    = count_bits(table->mask);
+#ifdef USE_PEXT
+        int bits         = mask_bits;
+#else
+        int bits         = (piece == bishop ? bishop_bits[i] : rook_bits[i]);
+#endif
+        table->shift     = 64 - bits;
+
+        int position_indexes = 1 << mask_bits;
+        for (int j = 0; j < position_indexes; ++j) {
+            u64 position = set_positions(j, mask_bits, table->mask);
+            attacks[slider_index(table, position)] =
+                    (piece == bishop ? generate_bishop_attacks(i, position)
+                                     : generate_rook_attacks(i, position));
+        }
+
+        attacks += 1 << bits;
+    }
+}
 
-        u64 attack_mask = (piece == bishop ? bishop_masks[i] : rook_masks[i]);
-        int bits        = count_bits(attack_mask);
-        int position_indexes = 1 << bits;
+/* Squares strictly between two squares sharing a rank, file or diagonal, and
+ * that whole line edge to edge; both stay empty for squares that do not line
+ * up. generate_moves() builds its check and pin masks from these.
+ */
+static inline void init_line_tables(u64 between[64][64], u64 line[64][64])
+{
+    for (int i = 0; i < 64; ++i) {
+        for (int j = 0; j < 64; ++j) {
+            between[i][j] = line[i][j] = 0ULL;
+            if (i == j)
+                continue;
+
+            u64 ends                 = (1ULL << i) | (1ULL << j);
+            u64 (*attacks)(int, u64) = NULL;
+            if (generate_rook_attacks(i, 0ULL) & (1ULL << j))
+                attacks = generate_rook_attacks;
+            else if (generate_bishop_attacks(i, 0ULL) & (1ULL << j))
+                attacks = generate_bishop_attacks;
+            else
+                continue;
 
-        for (int j = 0; j < position_indexes; ++j) {
-            u64 position = set_positions(j, bits, attack_mask);
-            if (piece == bishop) {
-                int magic_idx =
-                        (position * bishop_magics[i]) >> (64 - bishop_bits[i]);
-                bishop_attacks[i][magic_idx] =
-                        generate_bishop_attacks(i, position);
-            } else {
-                int magic_idx =
-                        (position * rook_magics[i]) >> (64 - rook_bits[i]);
-                rook_attacks[i][magic_idx] = generate_rook_attacks(i, position);
-            }
+            between[i][j] = attacks(i, ends) & attacks(j, ends);
+            line[i][j]    = (attacks(i, 0ULL) & attacks(j, 0ULL)) | ends;
         }
     }
 }
 
+/* FNV-1a over everything a lookup depends on, attack pointers as offsets */
+u64 slider_checksum(const struct magic_t *bishops, const struct magic_t *rooks,
+                    const u64 *slider)
+{
+    u64 hash = 14695981039346656037ULL;
+#define FNV(x) (hash = (hash ^ ( u64 )(x)) * 1099511628211ULL)
+    for (int i = 0; i < 64; ++i) {
+        FNV(bishops[i].attacks - slider);
+        FNV(bishops[i].mask);
+        FNV(bishops[i].magic);
+        FNV(bishops[i].shift);
+        FNV(rooks[i].attacks - slider);
+        FNV(rooks[i].mask);
+        FNV(rooks[i].magic);
+        FNV(rooks[i].shift);
+    }
+    for (int i = 0; i < SLIDER_ATTACKS_SIZE; ++i)
+        FNV(slider[i]);
+#undef FNV
+    return hash;
+}
+
+int verify_slider_tables(void)
+{
+    return slider_checksum(bishop_table, rook_table, slider_attacks) ==
+           slider_tables_checksum;
+}
+
 static inline u64 get_bishop_attacks(int square, u64 position)
 {
-    position  &= bishop_masks[square];
-    position  *= bishop_magics[square];
-    position >>= 64 - bishop_bits[square];
-    return bishop_attacks[square][position];
+    const struct magic_t *table = &bishop_table[square];
+    return table->attacks[slider_index(table, position)];
 }
 
 static inline u64 get_rook_attacks(int square, u64 position)
 {
-    position  &= rook_masks[square];
-    position  *= rook_magics[square];
-    position >>= 64 - rook_bits[square];
-    return rook_attacks[square][position];
+    const struct magic_t *table = &rook_table[square];
+    return table->attacks[slider_index(table, position)];
 }
 
 static inline u64 get_queen_attacks(int square, u64 position)
 {
-    u64 result       = 0ULL;
-    u64 bishop_pos   = position;
-    u64 rook_pos     = position;
-
-    bishop_pos      &= bishop_masks[square];
-    bishop_pos      *= bishop_magics[square];
-    bishop_pos     >>= 64 - bishop_bits[square];
-    result          |= bishop_attacks[square][bishop_pos];
-
-    rook_pos        &= rook_masks[square];
-    rook_pos        *= rook_magics[square];
-    rook_pos       >>= 64 - rook_bits[square];
-    result          |= rook_attacks[square][rook_pos];
-
-    return result;
+    return get_bishop_attacks(square, position) |
+           get_rook_attacks(square, position);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //                                     Inits                                  //
 ////////////////////////////////////////////////////////////////////////////////
 
+/* The slider tables are generated ahead of time, so only debug builds pay
+ * for touching them here.
+ */
 void init_all(void)
 {
-    init_slider_attacks(bishop);
-    init_slider_attacks(rook);
+    init_bitops();
+    init_zobrist();
+    init_eval();
+#ifndef NO_DEBUG
+    if (!verify_slider_tables())
+        DEBUG("init_all(): slider tables do not match their checksum, "
+              "rerun `make slider_tables`\n");
+#endif
 }
 
 void init_board(struct state_t *state)
@@ -1015,6 +1140,20 @@ void init_board(struct state_t *state)
 
     state->fullmoves        = 1;
 
+    state->undo_count       = 0;
+
+    state->current_best_move = 0;
+
+    for (int sq = a1; sq <= h8; ++sq) {
+        state->board[sq] = -1;
+        for (int i = P; i <= k; ++i)
+            if (get_bit(state->bitboards[i], sq))
+                state->board[sq] = i;
+    }
+
+    state->hash = generate_hash(state);
+    generate_eval(state);
+
     return;
 }
 
@@ -1030,36 +1169,131 @@ void init_board(struct state_t *state)
 
 static inline void add_move(struct move_list_t *moves, unsigned int move)
 {
-    moves->squares[move & 63].moves[moves->squares[move & 63].count++] = move;
-    ++moves->count;
+    moves->moves[moves->count++] = move;
     return;
 }
 
+void square_moves(struct move_list_t *list, int square,
+                  struct square_moves_t *view)
+{
+    view->count = 0;
+    for (int i = 0; i < list->count; ++i)
+        if ((list->moves[i] & MOVE_SOURCE) == ( unsigned int )square)
+            view->moves[view->count++] = list->moves[i];
+}
+
+/* Every piece of either colour attacking square through occupancy, which can
+ * leave out pieces that are about to move (the king stepping away from a
+ * slider, both pawns of an en passant capture).
+ */
+static inline u64 get_attackers(struct state_t *state, int square,
+                                u64 occupancy)
+{
+    u64 *bitboards = state->bitboards;
+
+    return (pawn_attacks[black][square] & bitboards[P]) |
+           (pawn_attacks[white][square] & bitboards[p]) |
+           (knight_attacks[square] & (bitboards[N] | bitboards[n])) |
+           (king_attacks[square] & (bitboards[K] | bitboards[k])) |
+           (get_bishop_attacks(square, occupancy) &
+            (bitboards[B] | bitboards[b] | bitboards[Q] | bitboards[q])) |
+           (get_rook_attacks(square, occupancy) &
+            (bitboards[R] | bitboards[r] | bitboards[Q] | bitboards[q]));
+}
+
+/* Whether side attacks square */
 int get_attacked(struct state_t *state, int square, int side)
 {
-    if (state->side < white && state->side > black)
+    if (side < white || side > black)
+        return 0;
+    /* filter_legal() asks about a king that was captured as get_lsb_index(0) */
+    if (square < a1 || square > h8)
         return 0;
 
-    if (pawn_attacks[state->side][square] &
-        ((side == white) ? state->bitboards[P] : state->bitboards[p]))
-        return 1;
-    if (knight_attacks[square] &
-        ((side == white) ? state->bitboards[N] : state->bitboards[n]))
-        return 1;
-    if (king_attacks[square] &
-        ((side == white) ? state->bitboards[K] : state->bitboards[k]))
-        return 1;
-    if (get_bishop_attacks(square, state->positions[both]) &
-        ((side == white) ? state->bitboards[B] : state->bitboards[b]))
-        return 1;
-    if (get_rook_attacks(square, state->positions[both]) &
-        ((side == white) ? state->bitboards[R] : state->bitboards[r]))
-        return 1;
-    if (get_queen_attacks(square, state->positions[both]) &
-        ((side == white) ? state->bitboards[Q] : state->bitboards[q]))
-        return 1;
+    return (get_attackers(state, square, state->positions[both]) &
+            state->positions[side]) != 0;
+}
 
-    return 0;
+/* Static exchange values, the king only ever takes last */
+const int see_values[6] = {100, 300, 300, 500, 900, 20000};
+
+/* Material the side to move comes out with after every capture on the
+ * target square, each side taking with its least valuable piece and free to
+ * stop when going on would lose more. Sliders behind the pieces taking are
+ * picked up as the squares in front of them empty.
+ */
+int see(struct state_t *state, unsigned int move)
+{
+    int source, target, piece, promo;
+    DECODE_MOVE(move, &source, &target, &piece, &promo);
+
+    u64 *bitboards = state->bitboards;
+    u64  diagonal  = bitboards[B] | bitboards[b] | bitboards[Q] | bitboards[q];
+    u64  straight  = bitboards[R] | bitboards[r] | bitboards[Q] | bitboards[q];
+    u64  occupancy = state->positions[both];
+    u64  from      = 1ULL << source;
+    int  side      = state->side;
+    int  gain[32];
+    int  depth = 0;
+
+    if (MOVE_PASSANT_FLAG(move)) {
+        gain[0]    = see_values[P];
+        occupancy ^= 1ULL << ((side == white) ? target - 8 : target + 8);
+    } else {
+        gain[0] = (state->board[target] >= 0)
+                          ? see_values[state->board[target] % 6]
+                          : 0;
+    }
+    if (promo != piece)
+        gain[0] += see_values[promo % 6] - see_values[P];
+
+    int on_square = see_values[promo % 6];
+    u64 attackers = get_attackers(state, target, occupancy);
+
+    while (from) {
+        ++depth;
+        gain[depth] = on_square - gain[depth - 1];
+        if ((-gain[depth - 1] > gain[depth] ? -gain[depth - 1]
+                                             : gain[depth]) < 0)
+            break;
+
+        occupancy ^= from;
+        attackers |= (get_bishop_attacks(target, occupancy) & diagonal) |
+                     (get_rook_attacks(target, occupancy) & straight);
+        attackers &= occupancy;
+        side      ^= 1;
+
+        from = 0ULL;
+        for (int p = P; p <= K; ++p) {
+            u64 own = attackers & bitboards[side * 6 + p];
+            if (own) {
+                from      = own & -own;
+                on_square = see_values[p];
+                break;
+            }
+        }
+        if (depth == 31)
+            break;
+    }
+
+    while (--depth)
+        gain[depth - 1] = -(-gain[depth - 1] > gain[depth] ? -gain[depth - 1]
+                                                            : gain[depth]);
+
+    return gain[0];
+}
+
+/* Enemy pieces attacking the king of the side to move */
+u64 get_checkers(struct state_t *state)
+{
+    int us   = state->side;
+    u64 king = state->bitboards[us == white ? K : k];
+
+    if (!king)
+        return 0ULL;
+
+    return get_attackers(state, get_lsb_index(king), state->positions[both]) &
+           state->positions[us ^ 1];
 }
 
 /* Castling rights update
@@ -1086,593 +1320,626 @@ const int castling_rights[64] = {
 };
 /* clang-format on */
 
-int make_move(struct state_t *state, unsigned int move, int move_flag)
+/* board[] has to agree with bitboards[] and positions[] square for square */
+int verify_board(struct state_t *state)
 {
-    struct state_t backup_state = {0};
-    if (move_flag == all_moves) {
-        // DEBUG("make_move(): backing up state\n");
-        BOARD_BACKUP(state, &backup_state);
-
-        int source, target, piece, promo;
-        // DEBUG("make_move(): decoding move\n");
-        DECODE_MOVE(move, &source, &target, &piece, &promo);
-        int capture  = MOVE_CAPTURE_FLAG(move) ? 1 : 0;
-        int dpush    = MOVE_DOUBLE_FLAG(move) ? 1 : 0;
-        int epass    = MOVE_PASSANT_FLAG(move) ? 1 : 0;
-        int castling = MOVE_CASTLE_FLAG(move) ? 1 : 0;
-        DEBUG("make_move(): move -> %s to %s (%s promo %s) - %s %s %s %s\n",
-              square_to_coord[source], square_to_coord[target],
-              unicode_pieces[piece], unicode_pieces[promo],
-              (capture ? "capture" : "-"), (capture ? "dpush" : "-"),
-              (capture ? "e.p" : "-"), (capture ? "castling" : "-"));
-
-        if (piece > k || piece < P) {
-            DEBUG("make_move(): decoded piece invalid got: %d\n", piece);
-            BOARD_RESTORE(&backup_state, state);
-        }
-        if (promo > k || promo < P) {
-            DEBUG("make_move(): decoded promotion piece invalid got: %d\n",
-                  promo);
-            BOARD_RESTORE(&backup_state, state);
-        }
+    for (int sq = a1; sq <= h8; ++sq) {
+        int piece = state->board[sq];
+        for (int i = P; i <= k; ++i)
+            if ((get_bit(state->bitboards[i], sq) != 0) != (piece == i))
+                return 0;
+        if ((get_bit(state->positions[white], sq) != 0) !=
+                    (piece >= P && piece <= K) ||
+            (get_bit(state->positions[black], sq) != 0) !=
+                    (piece >= p && piece <= k) ||
+            (get_bit(state->positions[both], sq) != 0) != (piece >= 0))
+            return 0;
+    }
+    return 1;
+}
 
-        pop_bit(state->bitboards[piece], source);
-        set_bit(state->bitboards[piece], target);
-        pop_bit(state->positions[state->side], source);
-        set_bit(state->positions[state->side], target);
-
-        if (capture) {
-            DEBUG("make_move(): capture move %s %s\n", square_to_coord[source],
-                  square_to_coord[target]);
-            int start_piece, end_piece;
-            if (state->side == white) {
-                start_piece = p;
-                end_piece   = k;
-            } else {
-                start_piece = P;
-                end_piece   = K;
-            }
-            for (int i = start_piece; i <= end_piece; ++i) {
-                if (get_bit(state->bitboards[i], target)) {
-                    pop_bit(state->bitboards[i], target);
-                    DEBUG("make_move(): captured %s (popping position board "
-                          "%d : side %d)\n",
-                          square_to_coord[target], (6 - start_piece) / 6,
-                          state->side);
-                    pop_bit(state->positions[(6 - start_piece) / 6], target);
-                    break;
-                }
-            }
-        }
+#ifdef VERIFY_HASH
+#include <stdlib.h>
 
-        if (promo > piece) {
-            DEBUG("make_move(): promoting piece from %s to %s\n",
-                  unicode_pieces[piece], unicode_pieces[promo]);
-            pop_bit(state->bitboards[piece], target);
-            set_bit(state->bitboards[promo], target);
-        }
+/* The incremental key has to match one computed from scratch, or die */
+static inline void verify_hash(struct state_t *state, const char *caller)
+{
+    if (state->hash == generate_hash(state))
+        return;
+    fprintf(stderr, "%s: hash %016llx, from scratch %016llx\n", caller,
+            state->hash, generate_hash(state));
+    abort();
+}
+#endif
 
-        if (epass) {
-            if (state->side == white) {
-                DEBUG("make_move(): en-passant capture on %s\n",
-                      square_to_coord[target - 8]);
-                pop_bit(state->bitboards[p], target - 8);
-                pop_bit(state->positions[black], target - 8);
-            } else {
-                DEBUG("make_move(): en-passant capture on %s\n",
-                      square_to_coord[target + 8]);
-                pop_bit(state->bitboards[P], target + 8);
-                pop_bit(state->positions[white], target + 8);
-            }
-        }
-        state->enpassant = no_sq;
+#ifdef VERIFY_EVAL
+#include <stdlib.h>
 
-        if (dpush) {
-            if (state->side == white)
-                state->enpassant = target - 8;
-            else
-                state->enpassant = target + 8;
-        }
+/* Likewise the incremental evaluation terms, which are rebuilt in place */
+static inline void verify_eval(struct state_t *state, const char *caller)
+{
+    int material[2] = {state->material[white], state->material[black]};
+    int phase       = state->phase;
+    int mg          = state->pst_mg;
+    int eg          = state->pst_eg;
+
+    generate_eval(state);
+    if (material[white] == state->material[white] &&
+        material[black] == state->material[black] &&
+        phase == state->phase && mg == state->pst_mg && eg == state->pst_eg)
+        return;
+    fprintf(stderr,
+            "%s: material %d/%d phase %d pst %d/%d, from scratch %d/%d %d "
+            "%d/%d\n",
+            caller, material[white], material[black], phase, mg, eg,
+            state->material[white], state->material[black], state->phase,
+            state->pst_mg, state->pst_eg);
+    abort();
+}
+#endif
 
-        if (castling) {
-            switch (target) {
-            case g1:
-                DEBUG("make_move(): white castles kingside\n");
-                pop_bit(state->bitboards[R], h1);
-                set_bit(state->bitboards[R], f1);
-                pop_bit(state->positions[white], h1);
-                set_bit(state->positions[white], f1);
-                break;
-            case c1:
-                DEBUG("make_move(): white castles queenside\n");
-                pop_bit(state->bitboards[R], a1);
-                set_bit(state->bitboards[R], d1);
-                pop_bit(state->positions[white], a1);
-                set_bit(state->positions[white], d1);
-                break;
-            case g8:
-                DEBUG("make_move(): black castles kingside\n");
-                pop_bit(state->bitboards[r], h8);
-                set_bit(state->bitboards[r], f8);
-                pop_bit(state->positions[black], h8);
-                set_bit(state->positions[black], f8);
-                break;
-            case c8:
-                DEBUG("make_move(): black castles queenside\n");
-                pop_bit(state->bitboards[r], a8);
-                set_bit(state->bitboards[r], d8);
-                pop_bit(state->positions[black], a8);
-                set_bit(state->positions[black], d8);
-                break;
-            }
-        }
-        state->castle &= castling_rights[source];
-        state->castle &= castling_rights[target];
+/* make_move(), unmake_move() and generate_moves() dispatch once on the side
+ * to move into a copy of their body that has the side as a constant, which
+ * folds away pawn directions, promotion ranks and castling squares.
+ * GENERIC_MOVEGEN keeps a single copy that branches at runtime instead.
+ */
+#ifdef GENERIC_MOVEGEN
+#define SIDE_SPECIALISED static __attribute__((noinline))
+#else
+#define SIDE_SPECIALISED static inline __attribute__((always_inline))
+#endif
+
+static inline void castle_rook(struct state_t *state, int rook, int from,
+                               int to)
+{
+    int side = (rook < 6) ? white : black;
+    pop_bit(state->bitboards[rook], from);
+    set_bit(state->bitboards[rook], to);
+    pop_bit(state->positions[side], from);
+    set_bit(state->positions[side], to);
+    state->board[from]  = -1;
+    state->board[to]    = rook;
+    state->hash        ^= piece_keys[rook][from] ^ piece_keys[rook][to];
+    state->pst_mg      += pst_mg[rook][to] - pst_mg[rook][from];
+    state->pst_eg      += pst_eg[rook][to] - pst_eg[rook][from];
+}
+
+SIDE_SPECIALISED int make_side_move(struct state_t *state, unsigned int move,
+                                    int move_flag, const int us)
+{
+    if (move_flag == only_captures && !MOVE_CAPTURE_FLAG(move))
+        return 0;
+
+    int source, target, piece, promo;
+    DECODE_MOVE(move, &source, &target, &piece, &promo);
+    int capture  = MOVE_CAPTURE_FLAG(move) ? 1 : 0;
+    int dpush    = MOVE_DOUBLE_FLAG(move) ? 1 : 0;
+    int epass    = MOVE_PASSANT_FLAG(move) ? 1 : 0;
+    int castling = MOVE_CASTLE_FLAG(move) ? 1 : 0;
+    DEBUG("make_move(): move -> %s to %s (%s promo %s) - %s %s %s %s\n",
+          square_to_coord[source], square_to_coord[target],
+          unicode_pieces[piece], unicode_pieces[promo],
+          (capture ? "capture" : "-"), (capture ? "dpush" : "-"),
+          (capture ? "e.p" : "-"), (capture ? "castling" : "-"));
+
+    if (piece > k || piece < P) {
+        DEBUG("make_move(): decoded piece invalid got: %d\n", piece);
+        return 0;
+    }
+    if (promo > k || promo < P) {
+        DEBUG("make_move(): decoded promotion piece invalid got: %d\n", promo);
+        return 0;
+    }
 
-        state->positions[both] =
-                0ULL | state->positions[white] | state->positions[black];
+#ifndef NO_DEBUG
+    assert(state->undo_count < MAX_UNDO);
+#endif
+    struct undo_t *undo =
+            &state->undo[state->undo_count++ & (MAX_UNDO - 1)];
+    undo->move      = move;
+    undo->captured  = -1;
+    undo->enpassant = state->enpassant;
+    undo->castle    = state->castle;
+    undo->fifty     = state->fifty;
+    undo->hash      = state->hash;
+
+    pop_bit(state->bitboards[piece], source);
+    set_bit(state->bitboards[piece], target);
+    pop_bit(state->positions[us], source);
+    set_bit(state->positions[us], target);
+    state->hash   ^= piece_keys[piece][source] ^ piece_keys[piece][target];
+    state->pst_mg += pst_mg[piece][target] - pst_mg[piece][source];
+    state->pst_eg += pst_eg[piece][target] - pst_eg[piece][source];
+
+    if (capture && state->board[target] >= 0) {
+        DEBUG("make_move(): capture move %s %s\n", square_to_coord[source],
+              square_to_coord[target]);
+        undo->captured = state->board[target];
+        DEBUG("make_move(): captured %s (popping position board %d : side "
+              "%d)\n",
+              square_to_coord[target], us ^ 1, us);
+        pop_bit(state->bitboards[undo->captured], target);
+        pop_bit(state->positions[us ^ 1], target);
+        state->hash   ^= piece_keys[undo->captured][target];
+        state->pst_mg -= pst_mg[undo->captured][target];
+        state->pst_eg -= pst_eg[undo->captured][target];
+    }
+    state->board[source] = -1;
+    state->board[target] = (promo > piece) ? promo : piece;
+
+    if (promo > piece) {
+        DEBUG("make_move(): promoting piece from %s to %s\n",
+              unicode_pieces[piece], unicode_pieces[promo]);
+        pop_bit(state->bitboards[piece], target);
+        set_bit(state->bitboards[promo], target);
+        state->hash ^= piece_keys[piece][target] ^ piece_keys[promo][target];
+        state->material[us] += piece_values[promo] - piece_values[piece];
+        state->phase        += phase_values[promo];
+        state->pst_mg       += pst_mg[promo][target] - pst_mg[piece][target];
+        state->pst_eg       += pst_eg[promo][target] - pst_eg[piece][target];
+    }
 
-        state->side    ^= 1;
+    if (epass) {
+        int behind = (us == white) ? target - 8 : target + 8;
+        int pawn   = (us == white) ? p : P;
+        DEBUG("make_move(): en-passant capture on %s\n",
+              square_to_coord[behind]);
+        pop_bit(state->bitboards[pawn], behind);
+        pop_bit(state->positions[us ^ 1], behind);
+        state->board[behind]  = -1;
+        state->hash          ^= piece_keys[pawn][behind];
+        state->pst_mg        -= pst_mg[pawn][behind];
+        state->pst_eg        -= pst_eg[pawn][behind];
+        undo->captured        = pawn;
+    }
+    if (undo->captured >= 0) {
+        state->material[us ^ 1] -= piece_values[undo->captured];
+        state->phase            -= phase_values[undo->captured];
+    }
+    if (state->enpassant != no_sq)
+        state->hash ^= enpassant_keys[state->enpassant];
+    state->enpassant = no_sq;
 
-        u64 king_board  = state->side == white ? state->bitboards[k]
-                                               : state->bitboards[K];
-        if (get_attacked(state, get_lsb_index(king_board), state->side)) {
-            BOARD_RESTORE(&backup_state, state);
-            return 0;
+    if (dpush) {
+        state->enpassant  = (us == white) ? target - 8 : target + 8;
+        state->hash      ^= enpassant_keys[state->enpassant];
+    }
+
+    if (castling && us == white) {
+        if (target == g1) {
+            DEBUG("make_move(): white castles kingside\n");
+            castle_rook(state, R, h1, f1);
+        } else {
+            DEBUG("make_move(): white castles queenside\n");
+            castle_rook(state, R, a1, d1);
+        }
+    } else if (castling) {
+        if (target == g8) {
+            DEBUG("make_move(): black castles kingside\n");
+            castle_rook(state, r, h8, f8);
+        } else {
+            DEBUG("make_move(): black castles queenside\n");
+            castle_rook(state, r, a8, d8);
         }
+    }
+    state->hash   ^= castle_keys[state->castle];
+    state->castle &= castling_rights[source];
+    state->castle &= castling_rights[target];
+    state->hash   ^= castle_keys[state->castle];
 
-        ++state->fullmoves;
+    if (piece == ((us == white) ? P : p) || undo->captured >= 0)
+        state->fifty = 0;
+    else
+        ++state->fifty;
+
+    state->positions[both] =
+            0ULL | state->positions[white] | state->positions[black];
+
+    state->side  = us ^ 1;
+    state->hash ^= side_key;
+    ++state->fullmoves;
+
+#ifndef NO_DEBUG
+    if (!verify_board(state))
+        DEBUG("make_move(): board out of step with bitboards after %s%s\n",
+              square_to_coord[source], square_to_coord[target]);
+#endif
+#ifdef VERIFY_HASH
+    verify_hash(state, "make_move()");
+#endif
+#ifdef VERIFY_EVAL
+    verify_eval(state, "make_move()");
+#endif
+
+    return 1;
+}
 
-        return 1;
-    } else {
-        if (MOVE_CAPTURE_FLAG(move))
-            make_move(state, move, all_moves);
+/* Moves are made in place and pushed onto the state's undo stack. Legality
+ * is not checked again: generate_moves() only hands out legal moves, moves
+ * from anywhere else go through apply_move() or filter_legal() first.
+ */
+int make_move(struct state_t *state, unsigned int move, int move_flag)
+{
+    if (state->side == white)
+        return make_side_move(state, move, move_flag, white);
+    return make_side_move(state, move, move_flag, black);
+}
+
+/* us is the side that made the move being taken back */
+SIDE_SPECIALISED void unmake_side_move(struct state_t *state, const int us)
+{
+    struct undo_t *undo =
+            &state->undo[--state->undo_count & (MAX_UNDO - 1)];
+
+    int source, target, piece, promo;
+    DECODE_MOVE(undo->move, &source, &target, &piece, &promo);
+
+    state->side = us;
+    --state->fullmoves;
+    state->enpassant = undo->enpassant;
+    state->castle    = undo->castle;
+    state->fifty     = undo->fifty;
+
+    int moved = (promo > piece) ? promo : piece;
+    pop_bit(state->bitboards[moved], target);
+    set_bit(state->bitboards[piece], source);
+    pop_bit(state->positions[us], target);
+    set_bit(state->positions[us], source);
+    state->board[source]  = piece;
+    state->board[target]  = -1;
+    state->pst_mg        += pst_mg[piece][source] - pst_mg[moved][target];
+    state->pst_eg        += pst_eg[piece][source] - pst_eg[moved][target];
+
+    if (promo > piece) {
+        state->material[us] -= piece_values[promo] - piece_values[piece];
+        state->phase        -= phase_values[promo];
+    }
+
+    if (undo->captured >= 0) {
+        int square = target;
+        if (MOVE_PASSANT_FLAG(undo->move))
+            square = (us == white) ? target - 8 : target + 8;
+        set_bit(state->bitboards[undo->captured], square);
+        set_bit(state->positions[us ^ 1], square);
+        state->board[square]     = undo->captured;
+        state->material[us ^ 1] += piece_values[undo->captured];
+        state->phase            += phase_values[undo->captured];
+        state->pst_mg           += pst_mg[undo->captured][square];
+        state->pst_eg           += pst_eg[undo->captured][square];
+    }
+
+    if (MOVE_CASTLE_FLAG(undo->move) && us == white) {
+        if (target == g1)
+            castle_rook(state, R, f1, h1);
         else
-            return 0;
+            castle_rook(state, R, d1, a1);
+    } else if (MOVE_CASTLE_FLAG(undo->move)) {
+        if (target == g8)
+            castle_rook(state, r, f8, h8);
+        else
+            castle_rook(state, r, d8, a8);
     }
-    return 0;
+
+    state->positions[both] =
+            0ULL | state->positions[white] | state->positions[black];
+
+    /* castle_rook() has stirred the hash as well */
+    state->hash = undo->hash;
+
+#ifdef VERIFY_HASH
+    verify_hash(state, "unmake_move()");
+#endif
+#ifdef VERIFY_EVAL
+    verify_eval(state, "unmake_move()");
+#endif
+#ifndef NO_DEBUG
+    if (!verify_board(state))
+        DEBUG("unmake_move(): board out of step with bitboards after %s%s\n",
+              square_to_coord[source], square_to_coord[target]);
+#endif
 }
 
-void generate_moves(struct state_t *state, struct move_list_t *list)
+/* Takes back the last move make_move() pushed */
+void unmake_move(struct state_t *state)
 {
-    if (!list)
+    if (state->undo_count <= 0)
         return;
 
-    u64 bitboard = 0ULL;
-    u64 attacks  = 0ULL;
+    if (state->side == black)
+        unmake_side_move(state, white);
+    else
+        unmake_side_move(state, black);
+}
 
-    int source, target = 0;
+static inline void add_piece_moves(struct move_list_t *list, int source,
+                                   int piece, u64 targets, u64 enemy)
+{
+    while (targets) {
+        int target = get_lsb_index(targets);
+        add_move(list, ENCODE_MOVE(source, target, piece, piece,
+                                   (get_bit(enemy, target) ? 1 : 0), 0, 0, 0));
+        pop_lsb(targets);
+    }
+}
+
+/* A pawn reaching the last rank comes in four, queen first */
+static inline void add_pawn_move(struct move_list_t *list, int source,
+                                 int target, int piece, int capture)
+{
+    if (target >= a2 && target <= h7) {
+        add_move(list,
+                 ENCODE_MOVE(source, target, piece, piece, capture, 0, 0, 0));
+        return;
+    }
 
+    for (int promo = piece + 4; promo > piece; --promo)
+        add_move(list,
+                 ENCODE_MOVE(source, target, piece, promo, capture, 0, 0, 0));
+}
+
+/* Legal moves only. The checkers and pinned pieces are found once up front
+ * and every piece's targets are cut down to the squares that answer a check
+ * and, when pinned, to its pin line; only king steps and en passant still
+ * look at the board after the move. mode picks which of them to build at
+ * all, see only_captures in types.h. Sets state->check on the way.
+ */
+SIDE_SPECIALISED void generate_side_moves(struct state_t     *state,
+                                         struct move_list_t *list, int mode,
+                                         const int us)
+{
     list->count = 0;
 
-    for (int piece = P; piece <= k; ++piece) {
-        bitboard = state->bitboards[piece];
-        /* white pawns & white king castling */
-        if (state->side == white) {
-            if (piece == P) {
-                while (bitboard) {
-                    source = get_lsb_index(bitboard);
-                    target = source + 8;
-
-                    if ((target >= 0 && target < 64) &&
-                        !get_bit(state->positions[both], target)) {
-                        /* promotion */
-                        if (source >= a7 && source <= h7) {
-                            add_move(list, ENCODE_MOVE(source, target, piece, B,
-                                                       0, 0, 0, 0));
-                            add_move(list, ENCODE_MOVE(source, target, piece, R,
-                                                       0, 0, 0, 0));
-                            add_move(list, ENCODE_MOVE(source, target, piece, N,
-                                                       0, 0, 0, 0));
-                            add_move(list, ENCODE_MOVE(source, target, piece, Q,
-                                                       0, 0, 0, 0));
-                            // promotions += 4;
-                            // moves      += 4;
-                        } else {
-                            if (!get_bit(state->positions[both], target)) {
-                                add_move(list,
-                                         ENCODE_MOVE(source, target, piece,
-                                                     piece, 0, 0, 0, 0));
-                                // ++moves;
-                                if ((source >= a2 && source <= h2) &&
-                                    !get_bit(state->positions[both],
-                                             target + 8)) {
-                                    add_move(list,
-                                             ENCODE_MOVE(source, (target + 8),
-                                                         piece, piece, 0, 1, 0,
-                                                         0));
-                                    // ++moves;
-                                }
-                            }
-                        }
-                    }
-
-                    attacks = pawn_attacks[state->side][source] &
-                              state->positions[black];
-
-                    while (attacks) {
-                        target = get_lsb_index(attacks);
-
-                        if ((target >= 0 && target < 64) &&
-                            get_bit(state->positions[black], target)) {
-                            /* capture promotion */
-                            if (source >= a7 && source <= h7) {
-                                add_move(list,
-                                         ENCODE_MOVE(source, target, piece, B,
-                                                     1, 0, 0, 0));
-                                add_move(list,
-                                         ENCODE_MOVE(source, target, piece, R,
-                                                     1, 0, 0, 0));
-                                add_move(list,
-                                         ENCODE_MOVE(source, target, piece, K,
-                                                     1, 0, 0, 0));
-                                add_move(list,
-                                         ENCODE_MOVE(source, target, piece, Q,
-                                                     1, 0, 0, 0));
-                                // promotions += 4;
-                                // captures   += 4;
-                                // moves      += 4;
-                            } else {
-                                if (get_bit(state->positions[black], target)) {
-                                    add_move(list,
-                                             ENCODE_MOVE(source, target, piece,
-                                                         piece, 1, 0, 0, 0));
-                                    // ++captures;
-                                    // ++moves;
-                                }
-                            }
-                        }
-
-                        pop_bit(attacks, target);
-                    }
-
-                    /* en passant */
-                    if (state->enpassant != no_sq) {
-                        u64 enpassant_attacks =
-                                pawn_attacks[state->side][source] &
-                                (1ULL << state->enpassant);
-                        if (enpassant_attacks) {
-                            int target_enpassant =
-                                    get_lsb_index(enpassant_attacks);
-                            add_move(list,
-                                     ENCODE_MOVE(source, target_enpassant,
-                                                 piece, piece, 1, 0, 1, 0));
-                            // ++captures;
-                            // ++eps;
-                            // ++moves;
-                        }
-                    }
-
-                    pop_bit(bitboard, source);
-                }
-            }
+    u64 *bitboards = state->bitboards;
+    int  them      = us ^ 1;
+    int  own_base  = (us == white) ? P : p; /* own_base + N is our knight */
+    int  foe_base  = (us == white) ? p : P;
+    int  up        = (us == white) ? 8 : -8;
 
-            /* castling */
-            if (piece == K) {
-                if (state->castle & WKCK) {
-                    if (!get_bit(state->positions[both], f1) &&
-                        !get_bit(state->positions[both], g1)) {
-                        if (!get_attacked(state, e1, black) &&
-                            !get_attacked(state, f1, black)) {
-                            add_move(list, ENCODE_MOVE(e1, g1, piece, piece, 0,
-                                                       0, 0, 1));
-                            // ++moves;
-                            // ++castles;
-                        }
-                    }
-                }
-                if (state->castle & WKCQ) {
-                    if (!get_bit(state->positions[both], d1) &&
-                        !get_bit(state->positions[both], c1) &&
-                        !get_bit(state->positions[both], b1)) {
-                        if (!get_attacked(state, d1, black) &&
-                            !get_attacked(state, e1, black)) {
-                            add_move(list, ENCODE_MOVE(e1, c1, piece, piece, 0,
-                                                       0, 0, 1));
-                            // ++moves;
-                            // ++castles;
-                        }
-                    }
-                }
-            }
-        }
+    u64 own       = state->positions[us];
+    u64 enemy     = state->positions[them];
+    u64 occupancy = state->positions[both];
+    u64 diagonal  = bitboards[foe_base + B] | bitboards[foe_base + Q];
+    u64 straight  = bitboards[foe_base + R] | bitboards[foe_base + Q];
 
-        /* black pawns & black king castling */
-        else if (state->side == black) {
-            if (piece == p) {
-                while (bitboard) {
-                    source = get_lsb_index(bitboard);
-                    target = source - 8;
-
-                    if ((target >= 0 && target < 64) &&
-                        !get_bit(state->positions[both], target)) {
-                        /* promotion */
-                        if (source >= a2 && source <= h2) {
-                            add_move(list, ENCODE_MOVE(source, target, piece, b,
-                                                       0, 0, 0, 0));
-                            add_move(list, ENCODE_MOVE(source, target, piece, r,
-                                                       0, 0, 0, 0));
-                            add_move(list, ENCODE_MOVE(source, target, piece, n,
-                                                       0, 0, 0, 0));
-                            add_move(list, ENCODE_MOVE(source, target, piece, q,
-                                                       0, 0, 0, 0));
-                            // promotions += 4;
-                            // moves      += 4;
-                        } else {
-                            if (!get_bit(state->positions[both], target)) {
-                                add_move(list,
-                                         ENCODE_MOVE(source, target, piece,
-                                                     piece, 0, 0, 0, 0));
-                                // ++moves;
-                                if ((source >= a7 && source <= h7) &&
-                                    !get_bit(state->positions[both],
-                                             target - 8)) {
-                                    add_move(list,
-                                             ENCODE_MOVE(source, (target - 8),
-                                                         piece, piece, 0, 1, 0,
-                                                         0));
-                                    // ++moves;
-                                }
-                            }
-                        }
-                    }
-
-                    attacks = pawn_attacks[state->side][source] &
-                              state->positions[white];
-
-                    while (attacks) {
-                        target = get_lsb_index(attacks);
-
-                        if ((target >= 0 && target < 64) &&
-                            get_bit(state->positions[white], target)) {
-                            /* capture promotion */
-                            if (source >= a2 && source <= h2) {
-                                add_move(list,
-                                         ENCODE_MOVE(source, target, piece, b,
-                                                     1, 0, 0, 0));
-                                add_move(list,
-                                         ENCODE_MOVE(source, target, piece, r,
-                                                     1, 0, 0, 0));
-                                add_move(list,
-                                         ENCODE_MOVE(source, target, piece, n,
-                                                     1, 0, 0, 0));
-                                add_move(list,
-                                         ENCODE_MOVE(source, target, piece, q,
-                                                     1, 0, 0, 0));
-                                // promotions += 4;
-                                // captures   += 4;
-                                // moves      += 4;
-                            } else {
-                                if (get_bit(state->positions[white], target)) {
-                                    add_move(list,
-                                             ENCODE_MOVE(source, target, piece,
-                                                         piece, 1, 0, 0, 0));
-                                    // ++captures;
-                                    // ++moves;
-                                }
-                            }
-                        }
-
-                        pop_bit(attacks, target);
-                    }
-
-                    /* en passant */
-                    if (state->enpassant != no_sq) {
-                        u64 enpassant_attacks =
-                                pawn_attacks[state->side][source] &
-                                (1ULL << state->enpassant);
-                        if (enpassant_attacks) {
-                            int target_enpassant =
-                                    get_lsb_index(enpassant_attacks);
-                            add_move(list,
-                                     ENCODE_MOVE(source, target_enpassant,
-                                                 piece, piece, 1, 0, 1, 0));
-                            // ++eps;
-                            // ++moves;
-                            // ++captures;
-                        }
-                    }
-
-                    pop_bit(bitboard, source);
-                }
-            }
+    u64 bitboard  = 0ULL;
+    u64 attacks   = 0ULL;
+    int source, target = 0;
 
-            /* castling */
-            if (piece == k) {
-                if (state->castle & BKCK) {
-                    if (!get_bit(state->positions[both], f8) &&
-                        !get_bit(state->positions[both], g8)) {
-                        if (!get_attacked(state, e8, white) &&
-                            !get_attacked(state, f8, white)) {
-                            add_move(list, ENCODE_MOVE(e8, g8, piece, piece, 0,
-                                                       0, 0, 1));
-                            // ++castles;
-                            // ++moves;
-                        }
-                    }
-                }
-                if (state->castle & BKCQ) {
-                    if (!get_bit(state->positions[both], d8) &&
-                        !get_bit(state->positions[both], c8) &&
-                        !get_bit(state->positions[both], b8)) {
-                        if (!get_attacked(state, d8, white) &&
-                            !get_attacked(state, e8, white)) {
-                            add_move(list, ENCODE_MOVE(e8, c8, piece, piece, 0,
-                                                       0, 0, 1));
-                            // ++castles;
-                            // ++moves;
-                        }
-                    }
-                }
-            }
-        }
+    if (!bitboards[own_base + K])
+        return;
 
-        /* knight */
-        if ((state->side == white) ? piece == N : piece == n) {
-            while (bitboard) {
-                source  = get_lsb_index(bitboard);
-
-                attacks = knight_attacks[source] &
-                          ((state->side == white) ? ~state->positions[white]
-                                                  : ~state->positions[black]);
-                while (attacks) {
-                    target = get_lsb_index(attacks);
-
-                    if ((state->side == white)
-                                ? !get_bit(state->positions[black], target)
-                                : !get_bit(state->positions[white], target)) {
-                        add_move(list, ENCODE_MOVE(source, target, piece, piece,
-                                                   0, 0, 0, 0));
-                        // ++captures;
-                        // ++moves;
-                    } else {
-                        add_move(list, ENCODE_MOVE(source, target, piece, piece,
-                                                   1, 0, 0, 0));
-                        // ++moves;
-                    }
-
-                    pop_bit(attacks, target);
-                }
-
-                pop_bit(bitboard, source);
-            }
-        }
+    int king     = get_lsb_index(bitboards[own_base + K]);
+    u64 checkers = get_attackers(state, king, occupancy) & enemy;
 
-        /* bishop */
-        if ((state->side == white) ? piece == B : piece == b) {
-            while (bitboard) {
-                source  = get_lsb_index(bitboard);
-
-                attacks = get_bishop_attacks(source, state->positions[both]) &
-                          ((state->side == white) ? ~state->positions[white]
-                                                  : ~state->positions[black]);
-                while (attacks) {
-                    target = get_lsb_index(attacks);
-
-                    if ((state->side == white)
-                                ? !get_bit(state->positions[black], target)
-                                : !get_bit(state->positions[white], target)) {
-                        add_move(list, ENCODE_MOVE(source, target, piece, piece,
-                                                   0, 0, 0, 0));
-                        // ++captures;
-                        // ++moves;
-                    } else {
-                        add_move(list, ENCODE_MOVE(source, target, piece, piece,
-                                                   1, 0, 0, 0));
-                        // ++moves;
-                    }
-
-                    pop_bit(attacks, target);
-                }
-
-                pop_bit(bitboard, source);
-            }
+    state->check = !checkers ? no_check
+                             : ((us == white) ? white_check : black_check);
+
+    if (mode == only_evasions && !checkers)
+        return;
+
+    /* where the mode lets a piece land, pawns decide for themselves */
+    int captures = (mode != only_quiets);
+    int quiets   = (mode != only_captures);
+    u64 targets  = ~own;
+    if (!quiets)
+        targets = enemy;
+    else if (!captures)
+        targets = ~occupancy;
+
+    /* a lone piece of ours between the king and an enemy slider is pinned */
+    u64 pinned = 0ULL;
+    bitboard   = (get_bishop_attacks(king, 0ULL) & diagonal) |
+                 (get_rook_attacks(king, 0ULL) & straight);
+    while (bitboard) {
+        u64 blockers = between_squares[king][get_lsb_index(bitboard)] &
+                       occupancy;
+        if (blockers && !(blockers & (blockers - 1)))
+            pinned |= blockers & own;
+        pop_lsb(bitboard);
+    }
+
+    /* the king is left out of the occupancy so that stepping back along a
+     * checking slider's line does not look safe */
+    attacks = king_attacks[king] & targets;
+    while (attacks) {
+        target = get_lsb_index(attacks);
+        if (!(get_attackers(state, target, occupancy ^ (1ULL << king)) &
+              enemy))
+            add_move(list, ENCODE_MOVE(king, target, own_base + K,
+                                       own_base + K,
+                                       (get_bit(enemy, target) ? 1 : 0), 0, 0,
+                                       0));
+        pop_lsb(attacks);
+    }
+
+    /* double check: only the king can move */
+    if (checkers & (checkers - 1))
+        return;
+
+    /* everything else must capture the checker or block its line */
+    u64 evasions = ~0ULL;
+    if (checkers)
+        evasions = checkers | between_squares[king][get_lsb_index(checkers)];
+
+    /* castling, the king's square is already known to be safe */
+    if (!checkers && quiets) {
+        int rank = (us == white) ? 0 : 56;
+        if ((state->castle & ((us == white) ? WKCK : BKCK)) &&
+            !(occupancy & (3ULL << (rank + f1))) &&
+            !(get_attackers(state, rank + f1, occupancy) & enemy) &&
+            !(get_attackers(state, rank + g1, occupancy) & enemy))
+            add_move(list, ENCODE_MOVE(rank + e1, rank + g1, own_base + K,
+                                       own_base + K, 0, 0, 0, 1));
+        if ((state->castle & ((us == white) ? WKCQ : BKCQ)) &&
+            !(occupancy & (7ULL << (rank + b1))) &&
+            !(get_attackers(state, rank + d1, occupancy) & enemy) &&
+            !(get_attackers(state, rank + c1, occupancy) & enemy))
+            add_move(list, ENCODE_MOVE(rank + e1, rank + c1, own_base + K,
+                                       own_base + K, 0, 0, 0, 1));
+    }
+
+    /* pawns */
+    bitboard = bitboards[own_base + P];
+    while (bitboard) {
+        source      = get_lsb_index(bitboard);
+        u64 allowed = evasions;
+        if (get_bit(pinned, source))
+            allowed &= line_squares[king][source];
+
+        /* pushes onto the last rank are promotions, not quiet moves */
+        int rank = (us == white) ? source / 8 : 7 - source / 8;
+        target   = source + up;
+        if (!get_bit(occupancy, target) && (rank == 6 ? captures : quiets)) {
+            if (get_bit(allowed, target))
+                add_pawn_move(list, source, target, own_base + P, 0);
+
+            /* double push from the pawn's own second rank */
+            if (rank == 1 && !get_bit(occupancy, target + up) &&
+                get_bit(allowed, target + up))
+                add_move(list, ENCODE_MOVE(source, target + up, own_base + P,
+                                           own_base + P, 0, 1, 0, 0));
         }
 
-        /* rook */
-        if ((state->side == white) ? piece == R : piece == r) {
-            while (bitboard) {
-                source  = get_lsb_index(bitboard);
-
-                attacks = get_rook_attacks(source, state->positions[both]) &
-                          ((state->side == white) ? ~state->positions[white]
-                                                  : ~state->positions[black]);
-                while (attacks) {
-                    target = get_lsb_index(attacks);
-
-                    if ((state->side == white)
-                                ? !get_bit(state->positions[black], target)
-                                : !get_bit(state->positions[white], target)) {
-                        add_move(list, ENCODE_MOVE(source, target, piece, piece,
-                                                   0, 0, 0, 0));
-                        // ++captures;
-                        // ++moves;
-                    } else {
-                        add_move(list, ENCODE_MOVE(source, target, piece, piece,
-                                                   1, 0, 0, 0));
-                        // ++moves;
-                    }
-
-                    pop_bit(attacks, target);
-                }
-
-                pop_bit(bitboard, source);
-            }
+        attacks = captures ? pawn_attacks[us][source] & enemy & allowed : 0ULL;
+        while (attacks) {
+            add_pawn_move(list, source, get_lsb_index(attacks), own_base + P,
+                          1);
+            pop_lsb(attacks);
         }
 
-        /* queen */
-        if ((state->side == white) ? piece == Q : piece == q) {
-            while (bitboard) {
-                source  = get_lsb_index(bitboard);
-
-                attacks = get_queen_attacks(source, state->positions[both]) &
-                          ((state->side == white) ? ~state->positions[white]
-                                                  : ~state->positions[black]);
-                while (attacks) {
-                    target = get_lsb_index(attacks);
-
-                    if ((state->side == white)
-                                ? !get_bit(state->positions[black], target)
-                                : !get_bit(state->positions[white], target)) {
-                        add_move(list, ENCODE_MOVE(source, target, piece, piece,
-                                                   0, 0, 0, 0));
-                        // ++captures;
-                        // ++moves;
-                    } else {
-                        add_move(list, ENCODE_MOVE(source, target, piece, piece,
-                                                   1, 0, 0, 0));
-                        // ++moves;
-                    }
-
-                    pop_bit(attacks, target);
-                }
-
-                pop_bit(bitboard, source);
-            }
+        pop_lsb(bitboard);
+    }
+
+    /* en passant takes a pawn off the king's rank along with the capturing
+     * one, so it gets its own look for sliders behind them */
+    if (state->enpassant != no_sq && captures) {
+        int victim = state->enpassant - up;
+        bitboard   = pawn_attacks[them][state->enpassant] &
+                     bitboards[own_base + P];
+        if (!(evasions & ((1ULL << state->enpassant) | (1ULL << victim))))
+            bitboard = 0ULL;
+
+        while (bitboard) {
+            source    = get_lsb_index(bitboard);
+            u64 after = (occupancy ^ (1ULL << source) ^ (1ULL << victim)) |
+                        (1ULL << state->enpassant);
+            if (!(get_bishop_attacks(king, after) & diagonal) &&
+                !(get_rook_attacks(king, after) & straight))
+                add_move(list, ENCODE_MOVE(source, state->enpassant,
+                                           own_base + P, own_base + P, 1, 0, 1,
+                                           0));
+            pop_lsb(bitboard);
         }
+    }
 
-        /* king */
-        if ((state->side == white) ? piece == K : piece == k) {
-            while (bitboard) {
-                source  = get_lsb_index(bitboard);
-
-                attacks = king_attacks[source] &
-                          ((state->side == white) ? ~state->positions[white]
-                                                  : ~state->positions[black]);
-                while (attacks) {
-                    target = get_lsb_index(attacks);
-
-                    if ((state->side == white)
-                                ? !get_bit(state->positions[black], target)
-                                : !get_bit(state->positions[white], target)) {
-                        add_move(list, ENCODE_MOVE(source, target, piece, piece,
-                                                   0, 0, 0, 0));
-                        // ++captures;
-                        // ++moves;
-                    } else {
-                        add_move(list, ENCODE_MOVE(source, target, piece, piece,
-                                                   1, 0, 0, 0));
-                        // ++moves;
-                    }
-
-                    pop_bit(attacks, target);
-                }
-
-                pop_bit(bitboard, source);
-            }
+    /* a pinned knight can never stay on its pin line */
+    bitboard = bitboards[own_base + N] & ~pinned;
+    while (bitboard) {
+        source = get_lsb_index(bitboard);
+        add_piece_moves(list, source, own_base + N,
+                        knight_attacks[source] & targets & evasions, enemy);
+        pop_lsb(bitboard);
+    }
+
+    /* bishops, rooks and queens */
+    for (int piece = own_base + B; piece <= own_base + Q; ++piece) {
+        bitboard = bitboards[piece];
+        while (bitboard) {
+            source = get_lsb_index(bitboard);
+
+            if (piece == own_base + B)
+                attacks = get_bishop_attacks(source, occupancy);
+            else if (piece == own_base + R)
+                attacks = get_rook_attacks(source, occupancy);
+            else
+                attacks = get_queen_attacks(source, occupancy);
+
+            attacks &= targets & evasions;
+            if (get_bit(pinned, source))
+                attacks &= line_squares[king][source];
+
+            add_piece_moves(list, source, piece, attacks, enemy);
+            pop_lsb(bitboard);
         }
     }
 
     return;
 }
 
+void generate_moves(struct state_t *state, struct move_list_t *list, int mode)
+{
+    if (!list)
+        return;
+
+    if (state->side == white)
+        generate_side_moves(state, list, mode, white);
+    else
+        generate_side_moves(state, list, mode, black);
+}
+
+/* The transposition table only keeps enough of a move to pick it out of
+ * this position's move list, 0 when there is no entry or it does not fit
+ */
+unsigned int tt_best_move(struct state_t *state)
+{
+    struct tt_hit_t hit;
+    if (!tt_probe(state->hash, &hit) || !hit.move)
+        return 0;
+
+    struct move_list_t moves[1];
+    generate_moves(state, moves, all_moves);
+    for (int i = 0; i < moves->count; ++i)
+        if (tt_pack_move(moves->moves[i]) == hit.move)
+            return moves->moves[i];
+
+    ++tt_stats.bad_moves;
+    return 0;
+}
+
+/* Drops the game's undo entries from before its last irreversible move,
+ * keeping that move itself for the counter move heuristic. Nothing takes
+ * back a move played through apply_move().
+ */
+static void trim_history(struct state_t *state)
+{
+    int keep = (state->fifty < GAME_HISTORY ? state->fifty : GAME_HISTORY) + 1;
+    if (keep >= state->undo_count)
+        return;
+
+    memmove(state->undo, state->undo + (state->undo_count - keep),
+            sizeof(struct undo_t) * keep);
+    state->undo_count = keep;
+}
+
+/* A move of 0 plays what search_position() left for this position. The
+ * shared table is only asked when no search ran here: Lazy SMP helpers write
+ * to it too, so its root entry may be another thread's shallower move.
+ */
 int apply_move(void *state, unsigned int enc_move)
 {
+    struct state_t *game_state = ( struct state_t * )state;
+
+    if (enc_move == 0x00000000)
+        enc_move = game_state->current_best_move;
     if (enc_move == 0x00000000)
-        enc_move = (( struct state_t * )state)->current_best_move;
+        enc_move = tt_best_move(game_state);
     DEBUG("apply_move(): applying move %d\n", enc_move);
-    if (make_move(( struct state_t * )state, enc_move, all_moves))
+
+    /* whatever the GUI or a peer sends must be one of this position's moves */
+    struct move_list_t moves[1];
+    generate_moves(game_state, moves, all_moves);
+    for (int i = 0; i < moves->count; ++i) {
+        if (moves->moves[i] != enc_move)
+            continue;
+        /* the searched move belonged to the position just left */
+        game_state->current_best_move = 0;
+        if (!make_move(game_state, enc_move, all_moves))
+            return 0;
+        trim_history(game_state);
         return 1;
+    }
+
+    DEBUG("apply_move(): move %d is not legal here\n", enc_move);
     return 0;
 }
 
@@ -1680,69 +1947,23 @@ int apply_move(void *state, unsigned int enc_move)
 //                                Evaluation //
 ////////////////////////////////////////////////////////////////////////////////
 
-double material_eval(struct state_t *state)
-{
-    double result = 0;
-
-    int k, kprime = 0;
-    int q, qprime = 0;
-    int r, rprime = 0;
-    int b, bprime = 0;
-    int n, nprime = 0;
-    int p, pprime = 0;
-    if (state->side == white) {
-        p      = count_bits(state->bitboards[0]);
-        pprime = count_bits(state->bitboards[6]);
-        n      = count_bits(state->bitboards[1]);
-        nprime = count_bits(state->bitboards[7]);
-        b      = count_bits(state->bitboards[2]);
-        bprime = count_bits(state->bitboards[8]);
-        r      = count_bits(state->bitboards[3]);
-        rprime = count_bits(state->bitboards[9]);
-        q      = count_bits(state->bitboards[4]);
-        qprime = count_bits(state->bitboards[10]);
-        k      = count_bits(state->bitboards[5]);
-        kprime = count_bits(state->bitboards[11]);
-    } else {
-        p      = count_bits(state->bitboards[6]);
-        pprime = count_bits(state->bitboards[0]);
-        n      = count_bits(state->bitboards[7]);
-        nprime = count_bits(state->bitboards[1]);
-        b      = count_bits(state->bitboards[8]);
-        bprime = count_bits(state->bitboards[2]);
-        r      = count_bits(state->bitboards[9]);
-        rprime = count_bits(state->bitboards[3]);
-        q      = count_bits(state->bitboards[10]);
-        qprime = count_bits(state->bitboards[4]);
-        k      = count_bits(state->bitboards[11]);
-        kprime = count_bits(state->bitboards[5]);
-    }
-
-    result += KING_WEIGHT * (( double )k - ( double )kprime);
-    result += QUEEN_WEIGHT * (( double )q - ( double )qprime);
-    result += ROOK_WEIGHT * (( double )r - ( double )rprime);
-    result += BISHOP_WEIGHT * (( double )b - ( double )bprime);
-    result += KNIGHT_WEIGHT * (( double )n - ( double )nprime);
-    result += PAWN_WEIGHT * (( double )p - ( double )pprime);
-
-    return result;
-}
-
+/* Copies the moves that do not leave the mover's king attacked into legal,
+ * for move lists that did not come from generate_moves().
+ */
 void filter_legal(struct state_t *state, struct move_list_t *moves,
                   struct move_list_t *legal)
 {
-    return;
-}
-
-double symmetric_eval(struct state_t *state, struct move_list_t *moves)
-{
-    double score     = 0.0;
-    double material  = material_eval(state);
-    score           += material;
+    int king     = (state->side == white) ? K : k;
+    legal->count = 0;
 
-    score           += MOBILITY_WEIGHT * moves->count;
-
-    return score;
+    for (int i = 0; i < moves->count; ++i) {
+        if (!make_move(state, moves->moves[i], all_moves))
+            continue;
+        if (!get_attacked(state, get_lsb_index(state->bitboards[king]),
+                          state->side))
+            legal->moves[legal->count++] = moves->moves[i];
+        unmake_move(state);
+    }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1780,142 +2001,465 @@ int main(int argc, char **argv)
     puts("");
 
     struct move_list_t moves[1] = {0};
-    generate_moves(&game_state, moves);
+    generate_moves(&game_state, moves, all_moves);
     print_move_list(moves, 1);
 
     print_bitboard(knight_attacks[e4]);
 
-    struct state_t backup_state = {0};
+    for (int i = 0; i < moves->count; ++i) {
+        print_board(&game_state, 1);
+        // print_bitboard(positions[white]);
+        // print_bitboard(positions[black]);
+        // print_bitboard(positions[both]);
+        getchar();
+        if (!make_move(&game_state, moves->moves[i], all_moves))
+            continue;
+        print_board(&game_state, 1);
+        // print_bitboard(positions[white]);
+        // print_bitboard(positions[black]);
+        // print_bitboard(positions[both]);
+        unmake_move(&game_state);
+        getchar();
+    }
 
-    for (int i = 0; i < 64; ++i) {
-        for (int j = 0; j < moves->squares[i].count; ++j) {
-            BOARD_BACKUP(&game_state, &backup_state);
-            print_board(&game_state, 1);
-            // print_bitboard(positions[white]);
-            // print_bitboard(positions[black]);
-            // print_bitboard(positions[both]);
-            getchar();
-            make_move(&game_state, moves->squares[i].moves[j], all_moves);
-            print_board(&game_state, 1);
-            // print_bitboard(positions[white]);
-            // print_bitboard(positions[black]);
-            // print_bitboard(positions[both]);
-            BOARD_RESTORE(&backup_state, &game_state);
-            getchar();
+    return 0;
+}
+#endif /* _BB_TEST */
+
+#ifdef _MAGIC_FINDER
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct magic_job_t {
+    int piece;
+    int square;
+    int bits;
+    u64 magic;
+};
+
+struct magic_job_t magic_jobs[128];
+int                next_magic_job = 0;
+pthread_mutex_t    magic_job_mu   = PTHREAD_MUTEX_INITIALIZER;
+
+/* Each job keeps shaving an index bit off its square until find_magic()
+ * gives up, so the printed tables only ever get denser.
+ */
+static void *magic_worker(void *arg)
+{
+    *seed ^= ( u64 )( long )arg * 0x9E3779B97F4A7C15ULL;
+
+    while (1) {
+        pthread_mutex_lock(&magic_job_mu);
+        int job = next_magic_job++;
+        pthread_mutex_unlock(&magic_job_mu);
+        if (job >= 128)
+            break;
+
+        struct magic_job_t *current = &magic_jobs[job];
+        for (int bits = current->bits - 1; bits > 0; --bits) {
+            u64 magic = find_magic(current->square, bits, current->piece);
+            if (!magic)
+                break;
+            current->bits  = bits;
+            current->magic = magic;
         }
     }
 
+    return NULL;
+}
+
+static long table_bytes(int piece)
+{
+    long entries = 0;
+    for (int i = 0; i < 64; ++i)
+        entries += 1L << magic_jobs[(piece == bishop ? 0 : 64) + i].bits;
+    return entries * sizeof(u64);
+}
+
+static void print_magic_tables(const char *name, int piece)
+{
+    struct magic_job_t *jobs = &magic_jobs[piece == bishop ? 0 : 64];
+
+    printf("const int %s_bits[64] = {\n", name);
+    for (int i = 0; i < 64; ++i)
+        printf("%s%3d,%s", (i % 8 ? "" : "   "), jobs[i].bits,
+               ((i + 1) % 8 ? "" : "\n"));
+    printf("};\n\nconst u64 %s_magics[64] = {\n", name);
+    for (int i = 0; i < 64; ++i) {
+        char value[32];
+        snprintf(value, sizeof(value), "%lluULL,", jobs[i].magic);
+        if (i % 2)
+            printf("%s\n", value);
+        else
+            printf("        %-32s", value);
+    }
+    printf("};\n\n");
+}
+
+int main(int argc, char **argv)
+{
+    magic_tries  = (argc > 1 ? atol(argv[1]) : 1000000);
+    long threads = (argc > 2 ? atol(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN));
+    if (threads < 1)
+        threads = 1;
+
+    for (int i = 0; i < 64; ++i) {
+        magic_jobs[i]      = (struct magic_job_t){bishop, i, bishop_bits[i],
+                                                  bishop_magics[i]};
+        magic_jobs[64 + i] = (struct magic_job_t){rook, i, rook_bits[i],
+                                                  rook_magics[i]};
+    }
+
+    long before = table_bytes(bishop) + table_bytes(rook);
+
+    pthread_t workers[threads];
+    for (long i = 0; i < threads; ++i)
+        pthread_create(&workers[i], NULL, magic_worker, ( void * )i);
+    for (long i = 0; i < threads; ++i)
+        pthread_join(workers[i], NULL);
+
+    long after = table_bytes(bishop) + table_bytes(rook);
+
+    printf("/* magic_finder: %ld threads, %ld tries per index size\n", threads,
+           magic_tries);
+    printf(" * unpacked [64][512] + [64][4096]: %ld bytes\n",
+           64L * (512 + 4096) * sizeof(u64));
+    printf(" * packed, previous magics:          %ld bytes\n", before);
+    printf(" * packed, these magics:             %ld bytes\n */\n\n", after);
+    printf("#define BISHOP_ATTACKS_SIZE %ld\n", table_bytes(bishop) / 8);
+    printf("#define ROOK_ATTACKS_SIZE   %ld\n\n", table_bytes(rook) / 8);
+    print_magic_tables("bishop", bishop);
+    print_magic_tables("rook", rook);
+
     return 0;
 }
-#endif /* _BB_TEST */
+#endif /* _MAGIC_FINDER */
 
-#ifdef _PERFT_TEST
+#ifdef _SLIDER_GEN
+struct magic_t gen_bishop_table[64];
+struct magic_t gen_rook_table[64];
+u64            gen_slider_attacks[SLIDER_ATTACKS_SIZE];
+u64            gen_between_squares[64][64];
+u64            gen_line_squares[64][64];
 
-#include "perft.h"
+static void print_slider_table(const char *name, const struct magic_t *tables)
+{
+    printf("const struct magic_t %s[64] = {\n", name);
+    for (int i = 0; i < 64; ++i)
+        printf("    {slider_attacks + %ld, 0x%016llxULL, 0x%016llxULL, %d},\n",
+               ( long )(tables[i].attacks - gen_slider_attacks),
+               tables[i].mask, tables[i].magic, tables[i].shift);
+    printf("};\n\n");
+}
+
+static void print_line_table(const char *name, u64 table[64][64])
+{
+    printf("const u64 %s[64][64] = {\n", name);
+    for (int i = 0; i < 64; ++i) {
+        printf("    {\n");
+        for (int j = 0; j < 64; ++j)
+            printf("%s0x%016llxULL,%s", (j % 3 ? " " : "        "),
+                   table[i][j], ((j + 1) % 3 && j != 63 ? "" : "\n"));
+        printf("    },\n");
+    }
+    printf("};\n\n");
+}
+
+/* Prints this build's half of slider_tables.c, `make slider_tables` runs
+ * it once for the magic build and once for the PEXT build.
+ */
+int main(int argc, char **argv)
+{
+#ifdef USE_PEXT
+    const char *build = "pext", *guard = "defined";
+    printf("\n"); /* appended after the magic build's half */
+#else
+    const char *build = "magic", *guard = "!defined";
+#endif
+
+    init_slider_attacks(bishop, gen_bishop_table, gen_slider_attacks);
+    init_slider_attacks(rook, gen_rook_table, gen_slider_attacks);
+
+    printf("/* slider_tables.c (%s build)\n", build);
+    printf(" * Generated by `make slider_tables` from init_slider_attacks() "
+           "in bb.c, do not\n * edit.\n */\n\n");
+    printf("#if !defined(_SLIDER_GEN) && %s(USE_PEXT)\n", guard);
+    printf("#include \"slider_tables.h\"\n\n/* clang-format off */\n");
+
+    printf("const u64 slider_attacks[] = {\n");
+    for (int i = 0; i < SLIDER_ATTACKS_SIZE; ++i)
+        printf("%s0x%016llxULL,%s", (i % 3 ? " " : "    "),
+               gen_slider_attacks[i], ((i + 1) % 3 ? "" : "\n"));
+    printf("%s};\n\n", (SLIDER_ATTACKS_SIZE % 3 ? "\n" : ""));
+
+    print_slider_table("bishop_table", gen_bishop_table);
+    print_slider_table("rook_table", gen_rook_table);
+
+    printf("const u64 slider_tables_checksum = 0x%016llxULL;\n",
+           slider_checksum(gen_bishop_table, gen_rook_table,
+                           gen_slider_attacks));
+    printf("/* clang-format on */\n#endif\n");
+
+#ifndef USE_PEXT
+    /* the line tables do not depend on the slider backend, so only the
+     * magic build's half carries them */
+    init_line_tables(gen_between_squares, gen_line_squares);
+
+    printf("\n#ifndef _SLIDER_GEN\n");
+    printf("#include \"slider_tables.h\"\n\n/* clang-format off */\n");
+    print_line_table("between_squares", gen_between_squares);
+    print_line_table("line_squares", gen_line_squares);
+    printf("/* clang-format on */\n#endif\n");
+#endif
+
+    return 0;
+}
+#endif /* _SLIDER_GEN */
+
+#ifdef _STARTUP_BENCH
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STARTUP_REPS 16
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ( double )ts.tv_sec * 1e9 + ( double )ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    struct magic_t bishops[64], rooks[64];
+    u64            between[64][64], line[64][64];
+    u64           *slider = malloc(sizeof(u64) * SLIDER_ATTACKS_SIZE);
+    if (!slider)
+        return 1;
+
+    /* what a debug build's init_all() adds: the first read of every page */
+    double start = now_ns();
+    int    valid = verify_slider_tables();
+    double cold  = now_ns() - start;
+
+    start = now_ns();
+    for (int i = 0; i < STARTUP_REPS; ++i)
+        init_all();
+    double init = (now_ns() - start) / STARTUP_REPS;
+
+    /* what init_all() used to do on every launch */
+    start = now_ns();
+    for (int i = 0; i < STARTUP_REPS; ++i) {
+        init_slider_attacks(bishop, bishops, slider);
+        init_slider_attacks(rook, rooks, slider);
+        init_line_tables(between, line);
+    }
+    double runtime = (now_ns() - start) / STARTUP_REPS;
+
+    int same = !memcmp(slider, slider_attacks,
+                       sizeof(u64) * SLIDER_ATTACKS_SIZE);
+    same &= !memcmp(between, between_squares, sizeof(between));
+    same &= !memcmp(line, line_squares, sizeof(line));
+    for (int i = 0; i < 64; ++i) {
+        same &= bishops[i].attacks - slider ==
+                bishop_table[i].attacks - slider_attacks;
+        same &= rooks[i].attacks - slider ==
+                rook_table[i].attacks - slider_attacks;
+        same &= bishops[i].mask == bishop_table[i].mask &&
+                bishops[i].magic == bishop_table[i].magic &&
+                bishops[i].shift == bishop_table[i].shift;
+        same &= rooks[i].mask == rook_table[i].mask &&
+                rooks[i].magic == rook_table[i].magic &&
+                rooks[i].shift == rook_table[i].shift;
+    }
+
+    printf("STARTUP: sliders %s, %ld table bytes\n",
+#ifdef USE_PEXT
+           "pext",
+#else
+           "magic",
+#endif
+           ( long )sizeof(u64) * SLIDER_ATTACKS_SIZE);
+    printf("STARTUP: checksum %s, runtime tables %s\n",
+           (valid ? "ok" : "MISMATCH"), (same ? "match" : "DIFFER"));
+    printf("STARTUP: init_all()             %12.0f ns\n", init);
+    printf("STARTUP: checksum, first touch  %12.0f ns\n", cold);
+    printf("STARTUP: runtime generation     %12.0f ns\t(x%.0f init_all)\n",
+           runtime, (init > 0 ? runtime / init : 0));
+
+    free(slider);
+    return !(valid && same);
+}
+#endif /* _STARTUP_BENCH */
 
-extern struct perft_t initial_position[14];
-extern struct perft_t position_two[6];
-extern struct perft_t position_three[8];
+#ifdef _MOVEGEN_BENCH
+#include <time.h>
 
-#define PERFT_ONE "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
-#define PERFT_TWO                                                              \
-    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -"
-#define PERFT_THREE "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"
+#include "fen.h"
 
-long nodes;
+#define CAPTURE_DEPTH 6
+#define BENCH_NS      250e6 /* per position and mode */
+
+/* kiwipete, two more of the usual perft positions and an open middlegame,
+ * all with plenty to take on most moves */
+static char *capture_positions[] = {
+        STATE1,
+        STATE3,
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+        "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 "
+        "10",
+};
 
-static inline void perft_driver(struct state_t *state, int depth)
+static long bench_nodes;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ( double )ts.tv_sec * 1e9 + ( double )ts.tv_nsec;
+}
+
+/* The shape of a quiescence search without the pruning: follow captures and
+ * promotions only, either generated on their own (staged) or picked out of
+ * every move the way the search would have had to before.
+ */
+static void capture_walk(struct state_t *state, int depth, int staged)
 {
-    if (depth == 0) {
-        ++nodes;
+    ++bench_nodes;
+    if (!depth)
         return;
+
+    struct move_list_t moves[1];
+    generate_moves(state, moves, staged ? only_captures : all_moves);
+
+    for (int i = 0; i < moves->count; ++i) {
+        unsigned int move = moves->moves[i];
+        if (!staged && !MOVE_CAPTURE_FLAG(move) &&
+            ((move & MOVE_PROMO) >> 16) == ((move & MOVE_PIECE) >> 12))
+            continue;
+        make_move(state, move, all_moves);
+        capture_walk(state, depth - 1, staged);
+        unmake_move(state);
     }
+}
 
-    struct move_list_t moves[1] = {0};
-    generate_moves(state, moves);
+int main(int argc, char **argv)
+{
+    init_all();
 
-    for (int i = 0; i < 64; ++i) {
-        for (int j = 0; j < moves->squares[i].count; ++j) {
-            struct state_t backup = {0};
-            BOARD_BACKUP(state, &backup);
-            if (make_move(state, moves->squares[i].moves[j], all_moves) > 0)
-                perft_driver(state, depth - 1);
-            BOARD_RESTORE(&backup, state);
+    struct state_t state = {0};
+
+    printf("MOVEGEN: captures and promotions only, depth %d\n\n",
+           CAPTURE_DEPTH);
+    printf("%-4s %12s %14s %14s\n", "pos", "nodes", "all_moves NPS",
+           "captures NPS");
+
+    int count = sizeof(capture_positions) / sizeof(capture_positions[0]);
+
+    double total[2] = {0};
+    long   nodes    = 0;
+    for (int i = 0; i < count; ++i) {
+        double elapsed[2];
+        long   walk = 0;
+        for (int staged = 0; staged < 2; ++staged) {
+            parse_fen(capture_positions[i], &state);
+
+            /* both modes walk the same tree, so time per walk compares */
+            int    reps  = 0;
+            double start = now_ns();
+            do {
+                bench_nodes = 0;
+                capture_walk(&state, CAPTURE_DEPTH, staged);
+                ++reps;
+            } while (now_ns() - start < BENCH_NS);
+            elapsed[staged]  = (now_ns() - start) / reps;
+            total[staged]   += elapsed[staged];
+            walk             = bench_nodes;
         }
+        nodes += walk;
+        printf("%-4d %12ld %14.0f %14.0f\t(x%.2f)\n", i + 1, walk,
+               walk * 1e9 / elapsed[0], walk * 1e9 / elapsed[1],
+               elapsed[0] / elapsed[1]);
     }
+    printf("%-4s %12ld %14.0f %14.0f\t(x%.2f)\n", "all", nodes,
+           nodes * 1e9 / total[0], nodes * 1e9 / total[1], total[0] / total[1]);
+
+    return 0;
 }
+#endif /* _MOVEGEN_BENCH */
+
+#ifdef _PERFT_TEST
+
+#include "perft.h"
+
+#ifdef USE_PEXT
+#define SLIDER_BACKEND "pext"
+#else
+#define SLIDER_BACKEND "magic"
+#endif
+
+#define NPS(nodes, ms) ((ms) > 0 ? ( long long )(nodes) * 1000 / (ms) : 0LL)
 
 #include <stdio.h>
 
 #include "fen.h"
 
+struct state_t state;
+
+static void perft_row(const char *name, int i, char *fen,
+                      struct perft_t *expected)
+{
+    parse_fen(fen, &state);
+    u64 start = get_time_ms();
+    u64 nodes = perft(&state, expected->depth, 0);
+    int end   = ( int )(get_time_ms() - start);
+
+    parse_fen(fen, &state);
+    start          = get_time_ms();
+    u64 bulk_nodes = perft(&state, expected->depth, 1);
+    int bulk_end   = ( int )(get_time_ms() - start);
+
+    printf("PERFT: %s[%d] (%dms)\tDepth: %d\tNodes: %llu\t\tExpected: "
+           "%lld \t(%lld)\tNPS: %lld\tBulk: %dms %lld (%lld)\n",
+           name, i, end, expected->depth, nodes, expected->nodes,
+           ( long long )(nodes - expected->nodes), NPS(nodes, end), bulk_end,
+           NPS(bulk_nodes, bulk_end),
+           ( long long )(bulk_nodes - expected->nodes));
+
+#ifdef PERFT_DETAILS
+    struct perft_t details = {.depth = expected->depth};
+    parse_fen(fen, &state);
+    perft_parallel(&state, &details, 0, 4);
+
+    const char *labels[8] = {"Captures", "EP",     "Castles", "Promotions",
+                             "Checks",   "Discov", "Double",  "Mates"};
+    u64        *got       = &details.captures;
+    u64        *want      = &expected->captures;
+
+    printf("DETAIL: %s[%d]\t", name, i);
+    for (int j = 0; j < 8; ++j)
+        printf("%s: %llu (%lld)%s", labels[j], got[j],
+               ( long long )(got[j] - want[j]), (j < 7 ? "  " : "\n"));
+#endif
+}
+
 int main(int argc, char **argv)
 {
     init_all();
 
-    struct state_t state = {0};
+    printf("PERFT: sliders %s\n\n", SLIDER_BACKEND);
 
-    for (int i = 0; i < 7 /* 14 */; ++i) {
-        nodes = 0;
-        // moves      = 0;
-        // eps        = 0;
-        // captures   = 0;
-        // promotions = 0;
-        // castles    = 0;
-        parse_fen(PERFT_ONE, &state);
-        int start = get_time_ms();
-        perft_driver(&state, initial_position[i].depth);
-        int end = get_time_ms() - start;
-        printf("PERFT: POS1[%d] (%dms)\tDepth: %d\tNodes: %ld\t\tExpected: "
-               "%lld \t(%lld)\n",
-               i, end, initial_position[i].depth, nodes,
-               initial_position[i].nodes, nodes - initial_position[i].nodes);
-        // printf("\t->Moves: %llu\tCaptures: %llu\tE.Ps: %llu\tCastles: "
-        //        "%llu\tPromotions: %llu\n",
-        //        moves, captures, eps, castles, promotions);
-    }
+    for (int i = 0; i < 7 /* 14 */; ++i)
+        perft_row("POS1", i, PERFT_ONE, &initial_position[i]);
     puts("");
-    memset(&state, 0, sizeof(struct state_t));
-    for (int i = 0; i < 5 /* 6 */; ++i) {
-        nodes = 0;
-        // moves      = 0;
-        // eps        = 0;
-        // captures   = 0;
-        // promotions = 0;
-        // castles    = 0;
-        parse_fen(PERFT_TWO, &state);
-        int start = get_time_ms();
-        perft_driver(&state, position_two[i].depth);
-        int end = get_time_ms() - start;
-        printf("PERFT: POS2[%d] (%dms)\tDepth: %d\tNodes: %ld\t\tExpected: "
-               "%lld \t(%lld)\n",
-               i, end, position_two[i].depth, nodes, position_two[i].nodes,
-               nodes - position_two[i].nodes);
-        // printf("\t->Moves: %llu\tCaptures: %llu\tE.Ps: %llu\tCastles: "
-        //        "%llu\tPromotions: %llu\n",
-        //        moves, captures, eps, castles, promotions);
-    }
+    for (int i = 0; i < 5 /* 6 */; ++i)
+        perft_row("POS2", i, PERFT_TWO, &position_two[i]);
     puts("");
-    memset(&state, 0, sizeof(struct state_t));
-    for (int i = 0; i < 6 /* 8 */; ++i) {
-        nodes = 0;
-        // moves      = 0;
-        // eps        = 0;
-        // captures   = 0;
-        // promotions = 0;
-        // castles    = 0;
-        parse_fen(PERFT_THREE, &state);
-        int start = get_time_ms();
-        perft_driver(&state, position_three[i].depth);
-        int end = get_time_ms() - start;
-        printf("PERFT: POS3[%d] (%dms)\tDepth: %d\tNodes: %ld\t\tExpected: "
-               "%lld \t(%lld)\n",
-               i, end, position_three[i].depth, nodes, position_three[i].nodes,
-               nodes - position_three[i].nodes);
-        // printf("\t->Moves: %llu\tCaptures: %llu\tE.Ps: %llu\tCastles: "
-        //        "%llu\tPromotions: %llu\n",
-        //        moves, captures, eps, castles, promotions);
-    }
+    for (int i = 0; i < 6 /* 8 */; ++i)
+        perft_row("POS3", i, PERFT_THREE, &position_three[i]);
+
     return 0;
 }
 
@@ -32,58 +32,32 @@
 #define BITBOARD_H
 
 #include "types.h"
+#include "slider_tables.h"
 
-int get_time_ms(void);
+u64 get_time_ms(void);
 
-static inline void print_tiles(void);
-static inline void print_bitboard(u64 bitboard);
-static inline void print_attacked(struct state_t *state, int side);
-static inline void print_board(struct state_t *state, int unicode);
-static inline void print_move(unsigned int move, int unicode);
-static inline void print_move_list(struct move_list_t *moves, int unicode);
+int  get_attacked(struct state_t *state, int square, int side);
+u64  get_checkers(struct state_t *state);
+int  see(struct state_t *state, unsigned int move);
+int  make_move(struct state_t *state, unsigned int move, int move_flag);
+void unmake_move(struct state_t *state);
+int  verify_board(struct state_t *state);
+void generate_moves(struct state_t *state, struct move_list_t *list, int mode);
+void square_moves(struct move_list_t *list, int square,
+                  struct square_moves_t *view);
 
-static inline u64 mask_pawn_attacks(int square, int side);
-static inline u64 mask_knight_attacks(int square);
-static inline u64 mask_king_attacks(int square);
-static inline u64 mask_bishop_attacks(int square);
-static inline u64 mask_rook_attacks(int square);
-static inline u64 generate_bishop_attacks(int square, u64 block);
-static inline u64 generate_rook_attacks(int square, u64 block);
-static inline u64 get_bishop_attacks(int square, u64 position);
-static inline u64 get_rook_attacks(int square, u64 position);
-static inline u64 get_queen_attacks(int square, u64 position);
+void init_all(void);
+void init_board(struct state_t *state);
 
-inline int get_attacked(struct state_t *state, int square, int side);
-int        make_move(struct state_t *state, unsigned int move, int move_flag);
-void       generate_moves(struct state_t *state, struct move_list_t *list);
+u64 slider_checksum(const struct magic_t *bishops, const struct magic_t *rooks,
+                    const u64 *slider);
+int verify_slider_tables(void);
 
-void               init_all(void);
-static inline void init_slider_attacks(int piece);
-void               init_board(struct state_t *state);
+void filter_legal(struct state_t *state, struct move_list_t *moves,
+                  struct move_list_t *legal);
 
-static inline int count_bits(u64 bitboard);
-static inline int get_lsb_index(u64 bitboard);
-static inline u64 set_positions(int idx, int mask_bit_count, u64 attack_mask);
-
-static inline u64 xorshift64(void);
-static inline u64 rand_u64(void);
-static inline u64 find_magic(int square, int m, int piece);
-
-#define KING_WEIGHT     ( double )200.0
-#define QUEEN_WEIGHT    ( double )9.0
-#define ROOK_WEIGHT     ( double )5.0
-#define BISHOP_WEIGHT   ( double )3.0
-#define KNIGHT_WEIGHT   ( double )3.0
-#define PAWN_WEIGHT     ( double )1.0
-#define BAD_PAWN_WEIGHT ( double )-0.5 // TODO: Implement bad pawn finder
-#define MOBILITY_WEIGHT ( double )0.1
-
-void   filter_legal(struct state_t *state, struct move_list_t *moves,
-                    struct move_list_t *legal);
-double material_count(struct state_t *state);
-double symmetric_eval(struct state_t *state, struct move_list_t *moves);
-
-int apply_move(void *state, unsigned int enc_move);
+unsigned int tt_best_move(struct state_t *state);
+int          apply_move(void *state, unsigned int enc_move);
 
 #endif /* BITBOARD_H */
 
@@ -0,0 +1,370 @@
+/* bitops.c
+ * Copyright 2025 h5law <dev@h5law.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+
+#include "types.h"
+#include "bitops.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Portable                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/* clang-format off */
+const int debruijn_index[64] = {
+     0,  1, 48,  2, 57, 49, 28,  3,
+    61, 58, 50, 42, 38, 29, 17,  4,
+    62, 55, 59, 36, 53, 51, 43, 22,
+    45, 39, 33, 30, 24, 18, 12,  5,
+    63, 47, 56, 27, 60, 41, 37, 16,
+    54, 35, 52, 21, 44, 32, 23, 11,
+    46, 26, 40, 15, 34, 20, 31, 10,
+    25, 14, 19,  9, 13,  8,  7,  6
+};
+/* clang-format on */
+
+#define DEBRUIJN_64 0x03F79D71B4CB0A89ULL
+
+static int portable_count(u64 bitboard)
+{
+    bitboard -= (bitboard >> 1) & 0x5555555555555555ULL;
+    bitboard  = (bitboard & 0x3333333333333333ULL) +
+               ((bitboard >> 2) & 0x3333333333333333ULL);
+    bitboard  = (bitboard + (bitboard >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return ( int )((bitboard * 0x0101010101010101ULL) >> 56);
+}
+
+static int portable_lsb(u64 bitboard)
+{
+    return debruijn_index[((bitboard & -bitboard) * DEBRUIJN_64) >> 58];
+}
+
+static u64 portable_pop_lsb(u64 bitboard)
+{
+    return bitboard & (bitboard - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Hardware                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef BITOPS_X86
+#include <immintrin.h>
+
+__attribute__((target("popcnt"))) static int popcnt_count(u64 bitboard)
+{
+    return __builtin_popcountll(bitboard);
+}
+
+static int bsf_lsb(u64 bitboard)
+{
+    return __builtin_ctzll(bitboard);
+}
+
+__attribute__((target("bmi"))) static int tzcnt_lsb(u64 bitboard)
+{
+    return ( int )_tzcnt_u64(bitboard);
+}
+
+__attribute__((target("bmi"))) static u64 blsr_pop_lsb(u64 bitboard)
+{
+    return _blsr_u64(bitboard);
+}
+#endif /* BITOPS_X86 */
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Dispatch                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+struct bitops_t bitops = {
+        bitops_portable,
+        portable_count,
+        portable_lsb,
+        portable_pop_lsb,
+};
+
+const char *bitops_names[bitops_count] = {"portable", "popcnt", "bmi"};
+
+const char *bitops_name(int backend)
+{
+    if (backend < bitops_portable || backend >= bitops_count)
+        return "unknown";
+    return bitops_names[backend];
+}
+
+int detect_bitops(void)
+{
+#ifdef BITOPS_X86
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("popcnt"))
+        return bitops_portable;
+    if (!__builtin_cpu_supports("bmi"))
+        return bitops_popcnt;
+    return bitops_bmi;
+#else
+    return bitops_portable;
+#endif
+}
+
+/* Returns the backend actually installed, which is lower than the one asked
+ * for when this CPU (or this build) cannot run it.
+ */
+int select_bitops(int backend)
+{
+    if (backend > detect_bitops())
+        backend = detect_bitops();
+
+    switch (backend) {
+#ifdef BITOPS_X86
+    case bitops_bmi:
+        bitops.count      = popcnt_count;
+        bitops.lsb        = tzcnt_lsb;
+        bitops.pop_lsb_fn = blsr_pop_lsb;
+        break;
+    case bitops_popcnt:
+        bitops.count      = popcnt_count;
+        bitops.lsb        = bsf_lsb;
+        bitops.pop_lsb_fn = portable_pop_lsb;
+        break;
+#endif
+    default:
+        backend           = bitops_portable;
+        bitops.count      = portable_count;
+        bitops.lsb        = portable_lsb;
+        bitops.pop_lsb_fn = portable_pop_lsb;
+        break;
+    }
+    bitops.backend = backend;
+
+    return backend;
+}
+
+void init_bitops(void)
+{
+    select_bitops(detect_bitops());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Bench                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef _BITOPS_BENCH
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bb.h"
+#include "fen.h"
+
+#define SAMPLE_CAP  (1 << 20)
+#define BENCH_DEPTH 3
+#define BENCH_REPS  16
+
+u64 *samples;
+int  sample_count;
+
+/* count_bits() and get_lsb_index() as they were before this module */
+static int legacy_count(u64 bitboard)
+{
+    unsigned int count = 0;
+    for (count = 0; bitboard; ++count)
+        bitboard &= bitboard - 1;
+    return count;
+}
+
+static int legacy_lsb(u64 bitboard)
+{
+    return legacy_count((bitboard & -bitboard) - 1);
+}
+
+static u64 legacy_pop_lsb(u64 bitboard)
+{
+    return bitboard & ~(1ULL << legacy_lsb(bitboard));
+}
+
+static void collect(struct state_t *state, int depth)
+{
+    for (int i = 0; i < 12 && sample_count < SAMPLE_CAP; ++i)
+        if (state->bitboards[i])
+            samples[sample_count++] = state->bitboards[i];
+    for (int i = 0; i < 3 && sample_count < SAMPLE_CAP; ++i)
+        samples[sample_count++] = state->positions[i];
+
+    if (!depth)
+        return;
+
+    struct move_list_t moves[1];
+    generate_moves(state, moves, all_moves);
+
+    for (int i = 0; i < moves->count; ++i) {
+        if (!make_move(state, moves->moves[i], all_moves))
+            continue;
+        collect(state, depth - 1);
+        unmake_move(state);
+    }
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ( double )ts.tv_sec * 1e9 + ( double )ts.tv_nsec;
+}
+
+volatile u64 sink;
+
+static double bench_count(int (*count)(u64))
+{
+    u64    acc   = 0;
+    double start = now_ns();
+    for (int r = 0; r < BENCH_REPS; ++r)
+        for (int i = 0; i < sample_count; ++i)
+            acc += count(samples[i]);
+    sink = acc;
+    return (now_ns() - start) / (( double )BENCH_REPS * sample_count);
+}
+
+static double bench_lsb(int (*lsb)(u64))
+{
+    u64    acc   = 0;
+    double start = now_ns();
+    for (int r = 0; r < BENCH_REPS; ++r)
+        for (int i = 0; i < sample_count; ++i)
+            acc += lsb(samples[i] | 0x8000000000000000ULL);
+    sink = acc;
+    return (now_ns() - start) / (( double )BENCH_REPS * sample_count);
+}
+
+/* The shape of every loop in generate_moves(): scan, use, reset. */
+static double bench_serialise(int (*lsb)(u64), u64 (*pop)(u64))
+{
+    u64    acc   = 0;
+    u64    ops   = 0;
+    double start = now_ns();
+    for (int r = 0; r < BENCH_REPS; ++r) {
+        for (int i = 0; i < sample_count; ++i) {
+            u64 bitboard = samples[i];
+            while (bitboard) {
+                acc      += lsb(bitboard);
+                bitboard  = pop(bitboard);
+                ++ops;
+            }
+        }
+    }
+    sink = acc;
+    return (now_ns() - start) / ( double )ops;
+}
+
+static double bench_inline_count(void)
+{
+    u64    acc   = 0;
+    double start = now_ns();
+    for (int r = 0; r < BENCH_REPS; ++r)
+        for (int i = 0; i < sample_count; ++i)
+            acc += bit_count(samples[i]);
+    sink = acc;
+    return (now_ns() - start) / (( double )BENCH_REPS * sample_count);
+}
+
+static double bench_inline_serialise(void)
+{
+    u64    acc   = 0;
+    u64    ops   = 0;
+    double start = now_ns();
+    for (int r = 0; r < BENCH_REPS; ++r) {
+        for (int i = 0; i < sample_count; ++i) {
+            u64 bitboard = samples[i];
+            while (bitboard) {
+                acc += bit_lsb(bitboard);
+                pop_lsb(bitboard);
+                ++ops;
+            }
+        }
+    }
+    sink = acc;
+    return (now_ns() - start) / ( double )ops;
+}
+
+int main(int argc, char **argv)
+{
+    init_all();
+
+    samples = malloc(sizeof(u64) * SAMPLE_CAP);
+    if (!samples)
+        return 1;
+
+    struct state_t state = {0};
+    parse_fen(STATE1, &state);
+    collect(&state, BENCH_DEPTH);
+
+    printf("BITOPS: detected %s, %d bitboards from perft depth %d\n\n",
+           bitops_name(detect_bitops()), sample_count, BENCH_DEPTH);
+
+    double legacy[3] = {bench_count(legacy_count), bench_lsb(legacy_lsb),
+                        bench_serialise(legacy_lsb, legacy_pop_lsb)};
+
+    printf("%-10s %12s %12s %12s\n", "backend", "count ns/op", "lsb ns/op",
+           "serial ns/op");
+    printf("%-10s %12.3f %12.3f %12.3f\n", "legacy", legacy[0], legacy[1],
+           legacy[2]);
+
+    for (int backend = bitops_portable; backend <= detect_bitops();
+         ++backend) {
+        select_bitops(backend);
+        for (int i = 0; i < sample_count; ++i) {
+            u64 bitboard = samples[i] | 0x8000000000000000ULL;
+            if (bitops.count(bitboard) != legacy_count(bitboard) ||
+                bitops.lsb(bitboard) != legacy_lsb(bitboard) ||
+                bitops.pop_lsb_fn(bitboard) != legacy_pop_lsb(bitboard)) {
+                printf("BITOPS: %s mismatch on %llu\n", bitops_name(backend),
+                       bitboard);
+                return 1;
+            }
+        }
+        double count  = bench_count(bitops.count);
+        double lsb    = bench_lsb(bitops.lsb);
+        double serial = bench_serialise(bitops.lsb, bitops.pop_lsb_fn);
+        printf("%-10s %12.3f %12.3f %12.3f\t(x%.1f x%.1f x%.1f)\n",
+               bitops_name(backend), count, lsb, serial, legacy[0] / count,
+               legacy[1] / lsb, legacy[2] / serial);
+    }
+
+    init_bitops();
+    double count  = bench_inline_count();
+    double serial = bench_inline_serialise();
+    printf("%-10s %12.3f %12s %12.3f\t(x%.1f      x%.1f)\n", "inline", count,
+           "-", serial, legacy[0] / count, legacy[2] / serial);
+
+    free(samples);
+    return 0;
+}
+#endif /* _BITOPS_BENCH */
+
+/* vim: ft=c ts=4 sts=4 sw=4 ai et cin */
@@ -0,0 +1,93 @@
+/* bitops.h
+ * Copyright 2025 h5law <dev@h5law.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BITOPS_H
+#define BITOPS_H
+
+#include "types.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BITOPS_X86
+#endif
+
+/* Bit manipulation backends
+ * portable - SWAR population count and de Bruijn LSB lookup
+ * popcnt   - POPCNT population count, BSF LSB scan
+ * bmi      - POPCNT population count, TZCNT LSB scan, BLSR LSB reset
+ */
+enum { bitops_portable, bitops_popcnt, bitops_bmi, bitops_count };
+
+struct bitops_t {
+    int backend;
+    int (*count)(u64 bitboard);
+    int (*lsb)(u64 bitboard);
+    u64 (*pop_lsb_fn)(u64 bitboard);
+};
+
+extern struct bitops_t bitops;
+
+void        init_bitops(void);
+int         select_bitops(int backend);
+int         detect_bitops(void);
+const char *bitops_name(int backend);
+
+/* The hot paths below only go through the dispatch table when the compiler
+ * could not already assume the instruction. BSF exists on every x86-64 part
+ * (and TZCNT decodes as REP BSF on older ones), so the LSB scan and the LSB
+ * reset are always inlined; only POPCNT needs the one-time CPU check.
+ */
+static inline int bit_count(u64 bitboard)
+{
+#if defined(__POPCNT__) || (defined(__GNUC__) && !defined(BITOPS_X86))
+    return __builtin_popcountll(bitboard);
+#else
+    return bitops.count(bitboard);
+#endif
+}
+
+static inline int bit_lsb(u64 bitboard)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(bitboard);
+#else
+    return bitops.lsb(bitboard);
+#endif
+}
+
+static inline u64 bit_pop_lsb(u64 bitboard)
+{
+    return bitboard & (bitboard - 1);
+}
+
+#define pop_lsb(bitboard) ((bitboard) = bit_pop_lsb(bitboard))
+
+#endif /* BITOPS_H */
+
+/* vim: ft=c ts=4 sts=4 sw=4 ai et cin */
@@ -0,0 +1,79 @@
+/* eval.h
+ * Copyright 2025 h5law <dev@h5law.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EVAL_H
+#define EVAL_H
+
+#include "types.h"
+
+/* Evaluation weights, in centipawns
+ * piece_values - each piece, kings count nothing as both are always on
+ * phase_values - each piece's share of the game phase, PHASE_TOTAL when
+ *                every minor and major piece is still on the board
+ */
+extern const int piece_values[12];
+extern const int phase_values[12];
+
+/* Piece-square bonuses by piece and square, black's negated
+ * pst_mg - midgame half, counts in full at PHASE_TOTAL
+ * pst_eg - endgame half, counts in full at phase 0
+ */
+extern int pst_mg[12][64];
+extern int pst_eg[12][64];
+
+#define PHASE_TOTAL     24
+#define MOBILITY_WEIGHT 10
+
+void init_eval(void);
+void generate_eval(struct state_t *state);
+int  symmetric_eval(struct state_t *state, struct move_list_t *moves);
+
+/* For the side to move, make_move() keeps both sides' material up to date */
+static inline int material_eval(struct state_t *state)
+{
+    return state->material[state->side] - state->material[state->side ^ 1];
+}
+
+/* Material plus the piece-square scores blended by phase, for the side to
+ * move. Promotions can push the phase past PHASE_TOTAL, it is capped here.
+ */
+static inline int tapered_eval(struct state_t *state)
+{
+    int phase = (state->phase < PHASE_TOTAL) ? state->phase : PHASE_TOTAL;
+    int pst   = (state->pst_mg * phase +
+               state->pst_eg * (PHASE_TOTAL - phase)) /
+              PHASE_TOTAL;
+
+    return material_eval(state) + ((state->side == white) ? pst : -pst);
+}
+
+#endif /* EVAL_H */
+
+/* vim: ft=c ts=4 sts=4 sw=4 ai et cin */
@@ -32,8 +32,10 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "eval.h"
 #include "fen.h"
 #include "types.h"
+#include "zobrist.h"
 
 extern char char_pieces[];
 
@@ -41,11 +43,15 @@ int parse_fen(char *fen, struct state_t *game_state)
 {
     memset(game_state->bitboards, 0, sizeof(u64) * 12);
     memset(game_state->positions, 0, sizeof(u64) * 3);
+    memset(game_state->board, -1, sizeof(int) * 64);
     game_state->side      = white;
     game_state->castle    = 0;
     game_state->enpassant = no_sq;
-    game_state->ply       = 0;
-    game_state->fullmoves = 1;
+    game_state->ply               = 0;
+    game_state->fifty             = 0;
+    game_state->fullmoves         = 1;
+    game_state->undo_count        = 0;
+    game_state->current_best_move = 0;
 
     char buf[512];
     snprintf(buf, 512, "%s", fen);
@@ -124,6 +130,7 @@ int parse_fen(char *fen, struct state_t *game_state)
         game_state->bitboards[piece]             |= (1ULL << square);
         game_state->positions[piece < 6 ? 0 : 1] |= (1ULL << square);
         game_state->positions[2]                 |= (1ULL << square);
+        game_state->board[square]                 = piece;
         file++;
     }
 
@@ -177,16 +184,21 @@ int parse_fen(char *fen, struct state_t *game_state)
         game_state->enpassant = rank * 8 + file;
     }
 
-    token = strtok(NULL, " ");
+    /* the move counters are left out often enough, the key is ready here */
+    game_state->hash = generate_hash(game_state);
+    generate_eval(game_state);
+
+    token            = strtok(NULL, " ");
     if (!token)
         return -1;
     for (char *c = token; *c != '\0'; c++) {
         if (*c < '0' || *c > '9')
             return -1;
     }
-    game_state->ply = atoi(token);
+    game_state->ply   = atoi(token);
+    game_state->fifty = game_state->ply;
 
-    token           = strtok(NULL, " ");
+    token             = strtok(NULL, " ");
     if (!token)
         return -1;
     for (char *c = token; *c != '\0'; c++) {
@@ -28,7 +28,18 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bb.h"
+#include "bitops.h"
 #include "perft.h"
+#include "zobrist.h"
 
 /* clang-format off */
 struct perft_t initial_position[14] = {
@@ -155,4 +166,934 @@ struct perft_t position_three[8] = {
 };
 /* clang-format on */
 
+////////////////////////////////////////////////////////////////////////////////
+//                                   Cache                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+#define PERFT_CACHE_PAGE 4096
+
+#define PERFT_DEPTH(data) (( int )((data) & 0xFF))
+#define PERFT_NODES(data) ((data) >> 8)
+
+#define PERFT_LOAD(x)     __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define PERFT_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+struct perft_cache_t                     perft_cache = {NULL, 0, 0, NULL};
+_Thread_local struct perft_cache_stats_t perft_cache_stats;
+
+/* A few Zobrist keys for the hashing and the compile time for the rest of
+ * the build, FNV-1a over the latter.
+ */
+static u64 perft_cache_fingerprint(void)
+{
+    const char *stamp = __DATE__ " " __TIME__;
+    u64         build = 14695981039346656037ULL;
+    while (*stamp)
+        build = (build ^ ( unsigned char )*stamp++) * 1099511628211ULL;
+
+    return PERFT_CACHE_MAGIC ^ piece_keys[P][a2] ^ piece_keys[k][e8] ^
+           castle_keys[15] ^ side_key ^ build;
+}
+
+/* Maps path, reusing what an earlier run left there when it was built with
+ * the same keys and budget, and starting it over otherwise.
+ */
+static void *perft_cache_map(const char *path, size_t bytes, u64 buckets)
+{
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    size_t      size  = PERFT_CACHE_PAGE + bytes;
+    int         fresh = fstat(fd, &st) || ( size_t )st.st_size != size;
+    if (fresh && (ftruncate(fd, 0) || ftruncate(fd, size))) {
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    struct perft_cache_header_t *header = map;
+    if (header->magic != PERFT_CACHE_MAGIC ||
+        header->version != PERFT_CACHE_VERSION ||
+        header->fingerprint != perft_cache_fingerprint() ||
+        header->buckets != buckets) {
+        memset(map, 0, size);
+        header->magic       = PERFT_CACHE_MAGIC;
+        header->version     = PERFT_CACHE_VERSION;
+        header->fingerprint = perft_cache_fingerprint();
+        header->buckets     = buckets;
+    }
+
+    return map;
+}
+
+/* Rounds down to a power of two buckets like tt_resize(). A path keeps the
+ * cache in that file between runs instead of in anonymous memory. Returns -1
+ * and leaves perft() uncached when neither can be had.
+ */
+int perft_cache_init(size_t megabytes, const char *path)
+{
+    size_t bytes   = megabytes * 1024 * 1024;
+    size_t buckets = 1;
+    while (buckets * 2 * sizeof(struct perft_bucket_t) <= bytes)
+        buckets *= 2;
+    bytes = buckets * sizeof(struct perft_bucket_t);
+
+    perft_cache_free();
+    if (!megabytes)
+        return 0;
+
+    void *table = NULL;
+    if (path) {
+        perft_cache.map = perft_cache_map(path, bytes, buckets);
+        if (!perft_cache.map)
+            return -1;
+        table = ( char * )perft_cache.map + PERFT_CACHE_PAGE;
+    } else {
+        if (posix_memalign(&table, 64, bytes))
+            return -1;
+        memset(table, 0, bytes);
+    }
+
+    perft_cache.buckets = table;
+    perft_cache.mask    = buckets - 1;
+    perft_cache.bytes   = bytes;
+
+    return 0;
+}
+
+void perft_cache_free(void)
+{
+    if (perft_cache.map)
+        munmap(perft_cache.map, PERFT_CACHE_PAGE + perft_cache.bytes);
+    else
+        free(perft_cache.buckets);
+
+    perft_cache.buckets = NULL;
+    perft_cache.mask    = 0;
+    perft_cache.bytes   = 0;
+    perft_cache.map     = NULL;
+}
+
+static inline int perft_cache_probe(u64 key, int depth, u64 *nodes)
+{
+    ++perft_cache_stats.probes;
+
+    struct perft_bucket_t *bucket =
+            &perft_cache.buckets[key & perft_cache.mask];
+    for (int i = 0; i < PERFT_CACHE_BUCKET; ++i) {
+        u64 data = PERFT_LOAD(bucket->entries[i].data);
+        if ((PERFT_LOAD(bucket->entries[i].key) ^ data) == key &&
+            PERFT_DEPTH(data) == depth) {
+            *nodes = PERFT_NODES(data);
+            ++perft_cache_stats.hits;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Deeper subtrees cost more to walk again, so the shallowest entry goes */
+static inline void perft_cache_store(u64 key, int depth, u64 nodes)
+{
+    ++perft_cache_stats.stores;
+
+    struct perft_bucket_t *bucket =
+            &perft_cache.buckets[key & perft_cache.mask];
+    struct perft_entry_t *replace = &bucket->entries[0];
+    for (int i = 1; i < PERFT_CACHE_BUCKET; ++i)
+        if (PERFT_DEPTH(PERFT_LOAD(bucket->entries[i].data)) <
+            PERFT_DEPTH(PERFT_LOAD(replace->data)))
+            replace = &bucket->entries[i];
+
+    u64 data = (nodes << 8) | ( u64 )(depth & 0xFF);
+    PERFT_STORE(replace->key, key ^ data);
+    PERFT_STORE(replace->data, data);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Perft                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/* Bulk counting stops one ply early and counts the legal moves there
+ * instead of making each of them, the plain walk is kept to check it. With
+ * perft_cache_init() called, subtrees two plies and deeper are looked up by
+ * position and depth before they are walked.
+ */
+u64 perft(struct state_t *state, int depth, int bulk)
+{
+    if (depth == 0)
+        return 1;
+
+    u64 nodes  = 0;
+    int cached = (perft_cache.buckets && depth >= 2);
+    if (cached && perft_cache_probe(state->hash, depth, &nodes))
+        return nodes;
+
+    struct move_list_t moves[1];
+    generate_moves(state, moves, all_moves);
+
+    if (bulk && depth == 1)
+        return moves->count;
+
+    /* every generated move is legal, nothing is tried and taken back */
+    for (int i = 0; i < moves->count; ++i) {
+        make_move(state, moves->moves[i], all_moves);
+        nodes += perft(state, depth - 1, bulk);
+        unmake_move(state);
+    }
+
+    if (cached)
+        perft_cache_store(state->hash, depth, nodes);
+
+    return nodes;
+}
+
+#ifdef PERFT_DETAILS
+/* A check is discovered when something other than the piece that moved (or
+ * the rook it castled with) gives it alone, double checks are only counted as
+ * double. The published tables count a double check that mates only as a
+ * mate: 8 of them at position two's depth 5 and 66 at depth 6.
+ */
+static void perft_leaf(struct state_t *state, unsigned int move,
+                       struct perft_t *result)
+{
+    int source, target, piece, promo;
+    DECODE_MOVE(move, &source, &target, &piece, &promo);
+
+    u64 moved = 1ULL << target;
+    if (MOVE_CASTLE_FLAG(move))
+        moved |= 1ULL << ((source + target) / 2);
+
+    result->nodes      += 1;
+    result->captures   += (MOVE_CAPTURE_FLAG(move) != 0);
+    result->ep         += (MOVE_PASSANT_FLAG(move) != 0);
+    result->castles    += (MOVE_CASTLE_FLAG(move) != 0);
+    result->promotions += (promo != piece);
+
+    make_move(state, move, all_moves);
+    u64 checkers = get_checkers(state);
+    if (checkers) {
+        struct move_list_t replies[1];
+        generate_moves(state, replies, only_evasions);
+
+        int is_double = (bit_count(checkers) > 1);
+
+        result->checks        += 1;
+        result->discovers     += ((checkers & ~moved) && !is_double);
+        result->double_checks += (is_double && replies->count);
+        result->checkmates    += (replies->count == 0);
+    }
+    unmake_move(state);
+}
+
+/* perft() with every counter in result filled in from the last ply's moves.
+ * Each leaf is made and looked at, so this runs at plain perft() speed at
+ * best and is only built with -DPERFT_DETAILS.
+ */
+void perft_details(struct state_t *state, struct perft_t *result, int depth)
+{
+    if (depth == 0) {
+        result->nodes += 1;
+        return;
+    }
+
+    struct move_list_t moves[1];
+    generate_moves(state, moves, all_moves);
+
+    for (int i = 0; i < moves->count; ++i) {
+        if (depth == 1) {
+            perft_leaf(state, moves->moves[i], result);
+            continue;
+        }
+        make_move(state, moves->moves[i], all_moves);
+        perft_details(state, result, depth - 1);
+        unmake_move(state);
+    }
+}
+#endif /* PERFT_DETAILS */
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Parallel                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/* A subtree handed to a worker, as the moves leading to it from the root */
+struct perft_job_t {
+    unsigned int moves[2];
+    int          length;
+};
+
+struct perft_pool_t {
+    struct state_t     *root;
+    struct perft_t     *result;
+    struct perft_job_t *jobs;
+    int                 job_count;
+    int                 next_job;
+    int                 bulk;
+};
+
+/* One subtree's counts added into sum, every counter with PERFT_DETAILS and
+ * just the nodes otherwise.
+ */
+static void perft_subtree(struct state_t *state, int depth, int bulk,
+                          struct perft_t *sum)
+{
+#ifdef PERFT_DETAILS
+    ( void )bulk;
+    perft_details(state, sum, depth);
+#else
+    sum->nodes += perft(state, depth, bulk);
+#endif
+}
+
+/* Every worker walks its own copy of the root, only the job counter and the
+ * totals are shared.
+ */
+static void *perft_worker(void *arg)
+{
+    struct perft_pool_t *pool  = arg;
+    struct state_t       state = *pool->root;
+
+    while (1) {
+        int job = __atomic_fetch_add(&pool->next_job, 1, __ATOMIC_RELAXED);
+        if (job >= pool->job_count)
+            break;
+
+        struct perft_job_t *current = &pool->jobs[job];
+        struct perft_t      counts  = {0};
+        for (int i = 0; i < current->length; ++i)
+            make_move(&state, current->moves[i], all_moves);
+        perft_subtree(&state, pool->result->depth - current->length,
+                      pool->bulk, &counts);
+        for (int i = 0; i < current->length; ++i)
+            unmake_move(&state);
+
+        __atomic_fetch_add(&pool->result->nodes, counts.nodes,
+                           __ATOMIC_RELAXED);
+#ifdef PERFT_DETAILS
+        /* the counters after nodes are laid out like an array */
+        u64 *from = &counts.captures;
+        u64 *to   = &pool->result->captures;
+        for (int i = 0; i < 8; ++i)
+            __atomic_fetch_add(&to[i], from[i], __ATOMIC_RELAXED);
+#endif
+    }
+
+    return NULL;
+}
+
+/* perft() of result->depth into result->nodes, with the root moves shared out
+ * between threads. A root with too few moves to keep them all busy is split
+ * again at depth 2. Built with PERFT_DETAILS every other counter is filled in
+ * too, as perft_details() would.
+ */
+void perft_parallel(struct state_t *state, struct perft_t *result, int bulk,
+                    int threads)
+{
+    if (threads < 1)
+        threads = 1;
+
+    *result = (struct perft_t){.depth = result->depth};
+    if (result->depth < 2) {
+        perft_subtree(state, result->depth, bulk, result);
+        return;
+    }
+
+    struct move_list_t root[1], replies[1];
+    generate_moves(state, root, all_moves);
+
+    int split = (result->depth > 2 &&
+                 root->count < threads * PERFT_JOBS_PER_THREAD);
+    struct perft_job_t *jobs = malloc(sizeof(struct perft_job_t) *
+                                      root->count * (split ? MAX_MOVES : 1));
+    if (!jobs) {
+        perft_subtree(state, result->depth, bulk, result);
+        return;
+    }
+
+    int job_count = 0;
+    for (int i = 0; i < root->count; ++i) {
+        if (!split) {
+            jobs[job_count++] = (struct perft_job_t){{root->moves[i], 0}, 1};
+            continue;
+        }
+
+        make_move(state, root->moves[i], all_moves);
+        generate_moves(state, replies, all_moves);
+        for (int j = 0; j < replies->count; ++j)
+            jobs[job_count++] = (struct perft_job_t){
+                    {root->moves[i], replies->moves[j]}, 2};
+        unmake_move(state);
+    }
+
+    struct perft_pool_t pool = {state, result, jobs, job_count, 0, bulk};
+
+    pthread_t workers[threads];
+    int       started = 0;
+    for (int i = 0; i < threads; ++i) {
+        if (pthread_create(&workers[i], NULL, perft_worker, &pool))
+            break;
+        ++started;
+    }
+    /* without a single thread the jobs are worked through right here */
+    if (!started)
+        perft_worker(&pool);
+    for (int i = 0; i < started; ++i)
+        pthread_join(workers[i], NULL);
+
+    free(jobs);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Bench                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef _PERFT_SCALING
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fen.h"
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ( double )ts.tv_sec * 1e3 + ( double )ts.tv_nsec / 1e6;
+}
+
+/* One wide root that splits on its own moves, one narrow root that needs
+ * the second ply to go round.
+ */
+static void scaling(const char *name, char *fen, struct perft_t *expected,
+                    int *counts, int count_size)
+{
+    struct state_t state = {0};
+    double         base  = 0;
+
+    printf("%s depth %d, bulk counting\n", name, expected->depth);
+    printf("%8s %12s %10s %14s %8s %10s\n", "threads", "nodes", "ms", "NPS",
+           "speedup", "efficiency");
+    for (int i = 0; i < count_size; ++i) {
+        struct perft_t result = {.depth = expected->depth};
+        parse_fen(fen, &state);
+
+        double start = now_ms();
+        perft_parallel(&state, &result, 1, counts[i]);
+        double ms = now_ms() - start;
+        if (i == 0)
+            base = ms;
+
+        printf("%8d %12llu %10.0f %14.0f %7.2fx %9.0f%%%s\n", counts[i],
+               result.nodes, ms, result.nodes * 1e3 / ms, base / ms,
+               100.0 * base / ms / counts[i],
+               (result.nodes == expected->nodes ? "" : "\tMISMATCH"));
+    }
+    puts("");
+}
+
+int main(int argc, char **argv)
+{
+    init_all();
+
+    long cores     = sysconf(_SC_NPROCESSORS_ONLN);
+    int  counts[5] = {1, 2, 4, 8};
+    int  size      = 4;
+    if (cores != 1 && cores != 2 && cores != 4 && cores != 8)
+        counts[size++] = ( int )cores;
+
+    printf("PERFT: %ld cores online\n\n", cores);
+    scaling("POS2", PERFT_TWO, &position_two[4], counts, size);
+    scaling("POS3", PERFT_THREE, &position_three[6], counts, size);
+
+    return 0;
+}
+#endif /* _PERFT_SCALING */
+
+#ifdef _PERFT_CACHE
+#include <stdio.h>
+#include <time.h>
+
+#include "fen.h"
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ( double )ts.tv_sec * 1e3 + ( double )ts.tv_nsec / 1e6;
+}
+
+static void cache_row(const char *name, char *fen, struct perft_t *expected,
+                      size_t megabytes, const char *path)
+{
+    struct state_t state = {0};
+
+    parse_fen(fen, &state);
+    double start = now_ms();
+    u64    plain = perft(&state, expected->depth, 1);
+    double ms    = now_ms() - start;
+
+    /* a cache on disk still holds whatever earlier runs stored */
+    perft_cache_init(megabytes, path);
+    memset(&perft_cache_stats, 0, sizeof(perft_cache_stats));
+    parse_fen(fen, &state);
+    start            = now_ms();
+    u64    nodes     = perft(&state, expected->depth, 1);
+    double cached_ms = now_ms() - start;
+    perft_cache_free();
+
+    printf("%-4s %5d %12llu %10.0f %10.0f %7.2fx %12llu %6.2f%%%s\n", name,
+           expected->depth, nodes, ms, cached_ms,
+           (cached_ms > 0 ? ms / cached_ms : 0), perft_cache_stats.probes,
+           (perft_cache_stats.probes
+                    ? 100.0 * perft_cache_stats.hits / perft_cache_stats.probes
+                    : 0),
+           (nodes == expected->nodes && plain == expected->nodes
+                    ? ""
+                    : "\tMISMATCH"));
+}
+
+int main(int argc, char **argv)
+{
+    size_t      megabytes = (argc > 1 ? strtoul(argv[1], NULL, 10) : 64);
+    const char *path      = (argc > 2 ? argv[2] : NULL);
+
+    init_all();
+
+    printf("PERFT: cache %zu MB %s%s, bulk counting\n\n", megabytes,
+           (path ? "on disk at " : "in memory"), (path ? path : ""));
+    printf("%-4s %5s %12s %10s %10s %8s %12s %7s\n", "pos", "depth", "nodes",
+           "plain ms", "cached ms", "speedup", "probes", "hits");
+    cache_row("POS1", PERFT_ONE, &initial_position[6], megabytes, path);
+    cache_row("POS2", PERFT_TWO, &position_two[4], megabytes, path);
+    cache_row("POS3", PERFT_THREE, &position_three[6], megabytes, path);
+
+    return 0;
+}
+#endif /* _PERFT_CACHE */
+
+#ifdef _PERFT_EPD
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fen.h"
+
+#define EPD_LINE   512
+#define EPD_DEPTHS 16
+
+extern const char *square_to_coord[64];
+extern const char  promoted_pieces[];
+
+struct epd_t {
+    char fen[EPD_LINE + 8];
+    u64  nodes[EPD_DEPTHS];
+    int  depths[EPD_DEPTHS];
+    int  count;
+};
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ( double )ts.tv_sec * 1e3 + ( double )ts.tv_nsec / 1e6;
+}
+
+/* "<fen> ;D1 20 ;D2 400 ..." with the move counters optional, as they are
+ * in most published suites.
+ */
+static int parse_epd(char *line, struct epd_t *epd)
+{
+    char *fields = strchr(line, ';');
+    if (!fields)
+        return -1;
+    *fields = '\0';
+    for (char *c = fields - 1; c >= line && *c == ' '; --c)
+        *c = '\0';
+    ++fields;
+
+    int spaces = 0;
+    for (char *c = line; *c; ++c)
+        if (*c == ' ' && c[1] && c[1] != ' ')
+            ++spaces;
+    snprintf(epd->fen, sizeof(epd->fen), "%s%s", line,
+             (spaces < 4 ? " 0 1" : ""));
+
+    epd->count = 0;
+    for (char *field = strtok(fields, ";"); field; field = strtok(NULL, ";")) {
+        int                depth;
+        unsigned long long nodes;
+        if (sscanf(field, " D%d %llu", &depth, &nodes) != 2)
+            continue;
+        if (depth < 1 || epd->count == EPD_DEPTHS)
+            return -1;
+        epd->depths[epd->count] = depth;
+        epd->nodes[epd->count]  = nodes;
+        ++epd->count;
+    }
+
+    return (epd->count ? 0 : -1);
+}
+
+/* Nodes under each root move, to be diffed against another engine's divide */
+static void divide(struct state_t *state, int depth)
+{
+    struct move_list_t moves[1];
+    generate_moves(state, moves, all_moves);
+
+    for (int i = 0; i < moves->count; ++i) {
+        unsigned int move = moves->moves[i];
+        int          source, target, piece, promo;
+        DECODE_MOVE(move, &source, &target, &piece, &promo);
+
+        make_move(state, move, all_moves);
+        u64 nodes = perft(state, depth - 1, 1);
+        unmake_move(state);
+
+        printf("    %s%s", square_to_coord[source], square_to_coord[target]);
+        if (promo != piece)
+            printf("%c", promoted_pieces[promo]);
+        printf(": %llu\n", nodes);
+    }
+}
+
+/* Every depth of one position, stopping at the first that is wrong. Returns
+ * 1 when the depth limit left nothing to run.
+ */
+static int run_epd(int index, struct epd_t *epd, int max_depth, int threads,
+                   u64 *total_nodes, double *total_ms)
+{
+    struct state_t state = {0};
+    u64            nodes = 0;
+    double         ms    = 0;
+    int            run   = 0;
+
+    if (parse_fen(epd->fen, &state) != 0) {
+        printf("%4d FAIL  bad fen: %s\n", index, epd->fen);
+        return -1;
+    }
+
+    for (int i = 0; i < epd->count; ++i) {
+        if (max_depth && epd->depths[i] > max_depth)
+            continue;
+
+        struct perft_t result = {.depth = epd->depths[i]};
+        double         start  = now_ms();
+        perft_parallel(&state, &result, 1, threads);
+        double elapsed = now_ms() - start;
+
+        nodes += result.nodes;
+        ms    += elapsed;
+        ++run;
+
+        if (result.nodes != epd->nodes[i]) {
+            printf("%4d FAIL  D%d %llu expected %llu: %s\n", index,
+                   result.depth, result.nodes, epd->nodes[i], epd->fen);
+            divide(&state, result.depth);
+            return -1;
+        }
+    }
+
+    if (!run) {
+        printf("%4d skip  no depth within the limit: %s\n", index, epd->fen);
+        return 1;
+    }
+
+    *total_nodes += nodes;
+    *total_ms    += ms;
+    printf("%4d ok   %12llu nodes %10.0f ms %14.0f NPS  %s\n", index, nodes, ms,
+           (ms > 0 ? nodes * 1e3 / ms : 0), epd->fen);
+
+    return 0;
+}
+
+/* The suite is mapped rather than read so its size is never a concern, each
+ * line is copied out only long enough to be parsed.
+ */
+int main(int argc, char **argv)
+{
+    const char *path      = (argc > 1 ? argv[1] : "src/ndjin/perft.epd");
+    int         max_depth = (argc > 2 ? atoi(argv[2]) : 0);
+    int         threads   = (argc > 3 ? atoi(argv[3]) : 1);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "%s: empty or unreadable\n", path);
+        close(fd);
+        return 1;
+    }
+    const char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror(path);
+        return 1;
+    }
+    madvise(( void * )data, st.st_size, MADV_SEQUENTIAL);
+
+    init_all();
+
+    printf("PERFT: %s, %s, %d thread%s, bulk counting\n\n", path,
+           (max_depth ? "depth limited" : "every depth"), threads,
+           (threads == 1 ? "" : "s"));
+
+    struct epd_t epd;
+    char         line[EPD_LINE];
+    const char  *end    = data + st.st_size;
+    int          passed = 0, failed = 0, skipped = 0, index = 0;
+    u64          nodes  = 0;
+    double       ms     = 0;
+
+    for (const char *cursor = data; cursor < end;) {
+        const char *eol = memchr(cursor, '\n', end - cursor);
+        if (!eol)
+            eol = end;
+        const char *start  = cursor;
+        size_t      length = eol - cursor;
+        cursor             = eol + 1;
+
+        while (length && (start[length - 1] == '\r' ||
+                          start[length - 1] == ' '))
+            --length;
+        if (!length || start[0] == '#')
+            continue;
+
+        ++index;
+        if (length >= EPD_LINE) {
+            printf("%4d FAIL  line longer than %d bytes\n", index, EPD_LINE);
+            ++failed;
+            continue;
+        }
+        memcpy(line, start, length);
+        line[length] = '\0';
+
+        if (parse_epd(line, &epd) != 0) {
+            printf("%4d FAIL  no ;D<depth> <nodes> fields: %s\n", index, line);
+            ++failed;
+            continue;
+        }
+
+        switch (run_epd(index, &epd, max_depth, threads, &nodes, &ms)) {
+        case 0:
+            ++passed;
+            break;
+        case 1:
+            ++skipped;
+            break;
+        default:
+            ++failed;
+            break;
+        }
+    }
+
+    munmap(( void * )data, st.st_size);
+
+    printf("\n%d passed, %d failed, %d skipped, %llu nodes in %.0f ms, "
+           "%.0f NPS\n",
+           passed, failed, skipped, nodes, ms, (ms > 0 ? nodes * 1e3 / ms : 0));
+
+    return (failed ? 1 : 0);
+}
+#endif /* _PERFT_EPD */
+
+#ifdef _PERFT_BENCH
+#include <stdio.h>
+#include <time.h>
+
+#include "fen.h"
+
+#ifdef USE_PEXT
+#define SLIDER_BACKEND "pext"
+#else
+#define SLIDER_BACKEND "magic"
+#endif
+
+#define BENCH_MAX_REPS 64
+
+/* Fixed so numbers from different builds line up, each a fraction of a
+ * second bulk counted.
+ */
+struct bench_t {
+    const char *name;
+    char       *fen;
+    int         depth;
+    u64         nodes;
+};
+
+/* clang-format off */
+struct bench_t bench_matrix[] = {
+    {"POS1", PERFT_ONE,   5, 4865609ULL},
+    {"POS2", PERFT_TWO,   4, 4085603ULL},
+    {"POS3", PERFT_THREE, 6, 11030083ULL},
+    {"POS4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+                          5, 15833292ULL},
+    {"POS5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+                          4, 2103487ULL},
+};
+/* clang-format on */
+
+#define BENCH_SIZE ( int )(sizeof(bench_matrix) / sizeof(bench_matrix[0]))
+
+static u64 now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ( u64 )ts.tv_sec * 1000000000ULL + ( u64 )ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    u64 x = *( const u64 * )a, y = *( const u64 * )b;
+    return (x > y) - (x < y);
+}
+
+/* median_nps of name in a file this bench wrote, 0 when it is not there */
+static double baseline_nps(const char *json, const char *name)
+{
+    char key[64];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+
+    const char *entry = strstr(json, key);
+    if (!entry)
+        return 0;
+    const char *field = strstr(entry, "\"median_nps\": ");
+    const char *end   = strchr(entry, '}');
+    if (!field || (end && field > end))
+        return 0;
+
+    return strtod(field + strlen("\"median_nps\": "), NULL);
+}
+
+static char *read_file(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long  size = ftell(file);
+    char *data = malloc(size + 1);
+    rewind(file);
+    if (data)
+        data[fread(data, 1, size, file)] = '\0';
+    fclose(file);
+
+    return data;
+}
+
+/* bench-perft: every position reps times, median and worst times kept. The
+ * median NPS is what gets compared against the baseline, regressing by more
+ * than threshold percent on any position fails the run.
+ */
+int main(int argc, char **argv)
+{
+    int         reps      = (argc > 1 ? atoi(argv[1]) : 5);
+    const char *output    = (argc > 2 ? argv[2] : "perft_bench.json");
+    const char *baseline  = (argc > 3 ? argv[3] : NULL);
+    double      threshold = (argc > 4 ? strtod(argv[4], NULL) : 5.0);
+
+    if (reps < 1 || reps > BENCH_MAX_REPS) {
+        fprintf(stderr, "reps must be 1 to %d\n", BENCH_MAX_REPS);
+        return 1;
+    }
+
+    init_all();
+
+    FILE *json = fopen(output, "w");
+    if (!json) {
+        perror(output);
+        return 1;
+    }
+
+    char *base = (baseline ? read_file(baseline) : NULL);
+    if (baseline && !base)
+        printf("PERFT: no baseline at %s, `cp %s %s` to start one\n",
+               baseline, output, baseline);
+
+    printf("PERFT: sliders %s, %d reps, bulk counting\n\n", SLIDER_BACKEND,
+           reps);
+    printf("%-4s %5s %10s %12s %12s %12s %9s\n", "pos", "depth", "nodes",
+           "median NPS", "min NPS", "max NPS", "baseline");
+
+    fprintf(json, "{\n  \"sliders\": \"%s\",\n  \"reps\": %d,\n",
+            SLIDER_BACKEND, reps);
+    fprintf(json, "  \"positions\": [\n");
+
+    int    regressed = 0, wrong = 0;
+    u64    total_nodes = 0;
+    double total_ns    = 0;
+
+    for (int i = 0; i < BENCH_SIZE; ++i) {
+        struct bench_t *bench = &bench_matrix[i];
+        struct state_t  state = {0};
+        u64             times[BENCH_MAX_REPS];
+        u64             nodes = 0;
+
+        parse_fen(bench->fen, &state);
+        perft(&state, bench->depth - 1, 1); /* warm up */
+
+        for (int r = 0; r < reps; ++r) {
+            u64 start = now_ns();
+            nodes     = perft(&state, bench->depth, 1);
+            times[r]  = now_ns() - start;
+        }
+        qsort(times, reps, sizeof(u64), compare_u64);
+
+        u64    median     = times[reps / 2];
+        double median_nps = nodes * 1e9 / median;
+        double min_nps    = nodes * 1e9 / times[reps - 1];
+        double max_nps    = nodes * 1e9 / times[0];
+        double base_nps   = (base ? baseline_nps(base, bench->name) : 0);
+        double change     = (base_nps > 0 ? 100.0 * (median_nps / base_nps - 1)
+                                          : 0);
+
+        total_nodes += nodes;
+        total_ns    += median;
+        wrong       += (nodes != bench->nodes);
+        regressed   += (base_nps > 0 && change < -threshold);
+
+        printf("%-4s %5d %10llu %12.0f %12.0f %12.0f", bench->name,
+               bench->depth, nodes, median_nps, min_nps, max_nps);
+        if (base_nps > 0)
+            printf(" %+8.1f%%%s", change,
+                   (change < -threshold ? "\tREGRESSED" : ""));
+        printf("%s\n", (nodes != bench->nodes ? "\tMISMATCH" : ""));
+
+        fprintf(json,
+                "    {\"name\": \"%s\", \"depth\": %d, \"nodes\": %llu, "
+                "\"median_ns\": %llu, \"min_ns\": %llu, \"max_ns\": %llu, "
+                "\"median_nps\": %.0f, \"min_nps\": %.0f, "
+                "\"max_nps\": %.0f}%s\n",
+                bench->name, bench->depth, nodes, median, times[0],
+                times[reps - 1], median_nps, min_nps, max_nps,
+                (i < BENCH_SIZE - 1 ? "," : ""));
+    }
+
+    double total_nps = total_nodes * 1e9 / total_ns;
+    fprintf(json, "  ],\n  \"total\": {\"nodes\": %llu, "
+                  "\"median_nps\": %.0f}\n}\n",
+            total_nodes, total_nps);
+    fclose(json);
+    free(base);
+
+    printf("\ntotal %llu nodes, %.0f NPS over the medians, written to %s\n",
+           total_nodes, total_nps, output);
+    if (regressed)
+        printf("%d position%s regressed more than %.1f%%\n", regressed,
+               (regressed == 1 ? "" : "s"), threshold);
+
+    return (regressed || wrong ? 1 : 0);
+}
+#endif /* _PERFT_BENCH */
+
 /* vim: ft=c ts=4 sts=4 sw=4 ai et cin */
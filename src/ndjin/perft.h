@@ -46,6 +46,85 @@ struct perft_t {
     u64 checkmates;
 };
 
+#define PERFT_ONE "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+#define PERFT_TWO                                                              \
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -"
+#define PERFT_THREE "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"
+
+extern struct perft_t initial_position[14];
+extern struct perft_t position_two[6];
+extern struct perft_t position_three[8];
+
+/* Root moves per thread below which perft_parallel() splits one ply deeper */
+#define PERFT_JOBS_PER_THREAD 4
+
+#define PERFT_CACHE_BUCKET  4
+#define PERFT_CACHE_MAGIC   0x65686361637466ULL /* "ftcache" */
+#define PERFT_CACHE_VERSION 1 /* bump with the header or entry layout */
+
+/* Perft cache entry data binary schema
+ * bits 0-7  remaining depth
+ * bits 8-63 subtree node count
+ *
+ * Stored XORed into the key like the search's table (see tt.h), so entries
+ * torn by two workers writing at once just miss. A subtree only counts for
+ * the depth it was walked to, so one position can hold several entries.
+ */
+struct perft_entry_t {
+    u64 key;
+    u64 data;
+};
+
+struct perft_bucket_t {
+    struct perft_entry_t entries[PERFT_CACHE_BUCKET];
+} __attribute__((aligned(64)));
+
+/* The first page of an on-disk cache, the buckets start after it
+ * magic       - PERFT_CACHE_MAGIC
+ * version     - PERFT_CACHE_VERSION, a file in another layout starts over
+ * fingerprint - mixes a few Zobrist keys and when perft.c was compiled
+ * buckets     - bucket count, the file is rebuilt when the budget changes
+ *
+ * The stored counts are only as right as the move generator that walked
+ * them, and the fingerprint only sees a new build of perft.c itself. Delete
+ * the cache file (perft_cache.bin for make perft_cache) after changing the
+ * move generator if perft.c may not have been compiled again.
+ */
+struct perft_cache_header_t {
+    u64 magic;
+    u64 version;
+    u64 fingerprint;
+    u64 buckets;
+};
+
+struct perft_cache_t {
+    struct perft_bucket_t *buckets;
+    u64                    mask;
+    size_t                 bytes;
+    void                  *map; /* whole mapping when on disk */
+};
+
+/* Per thread, like tt_stats */
+struct perft_cache_stats_t {
+    u64 probes;
+    u64 hits;
+    u64 stores;
+};
+
+extern struct perft_cache_t                     perft_cache;
+extern _Thread_local struct perft_cache_stats_t perft_cache_stats;
+
+int  perft_cache_init(size_t megabytes, const char *path);
+void perft_cache_free(void);
+
+u64  perft(struct state_t *state, int depth, int bulk);
+void perft_parallel(struct state_t *state, struct perft_t *result, int bulk,
+                    int threads);
+
+#ifdef PERFT_DETAILS
+void perft_details(struct state_t *state, struct perft_t *result, int depth);
+#endif
+
 #endif /* PERFT_H */
 
 /* vim: ft=c ts=4 sts=4 sw=4 ai et cin */
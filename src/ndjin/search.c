@@ -0,0 +1,947 @@
+/* search.c
+ * Copyright 2025 h5law <dev@h5law.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bb.h"
+#include "eval.h"
+#include "search.h"
+#include "tt.h"
+
+extern const char *square_to_coord[64];
+extern const char  promoted_pieces[];
+
+extern int quit;
+extern int timeset;
+extern int stopped;
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Helpers                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/* Helper threads and the running count of every thread's nodes are read
+ * across threads, each word only ever written by one of them.
+ */
+#define SEARCH_LOAD(x)     __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define SEARCH_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+/* A helper's search and the copy of the root it walks */
+struct search_thread_t {
+    struct search_t search;
+    struct state_t  state;
+    pthread_t       thread;
+};
+
+static struct search_thread_t *helpers;
+static int                     helper_count;
+
+static inline int evaluate(struct state_t *state)
+{
+    return tapered_eval(state);
+}
+
+/* Mates are stored as distance from the entry rather than from the root */
+static inline int score_to_tt(int score, int ply)
+{
+    if (score > MATE_BOUND)
+        return score + ply;
+    if (score < -MATE_BOUND)
+        return score - ply;
+    return score;
+}
+
+static inline int score_from_tt(int score, int ply)
+{
+    if (score > MATE_BOUND)
+        return score - ply;
+    if (score < -MATE_BOUND)
+        return score + ply;
+    return score;
+}
+
+/* Only positions since the last capture or pawn move can come round again,
+ * every other one of them with the same side to move.
+ */
+static inline int is_repetition(struct state_t *state)
+{
+    int reach = state->fifty;
+    if (reach > state->undo_count)
+        reach = state->undo_count;
+    if (reach > MAX_UNDO)
+        reach = MAX_UNDO;
+
+    for (int back = 2; back <= reach; back += 2)
+        if (state->undo[(state->undo_count - back) & (MAX_UNDO - 1)].hash ==
+            state->hash)
+            return 1;
+
+    return 0;
+}
+
+/* Every thread's nodes so far */
+static u64 search_nodes(struct search_t *search)
+{
+    u64 nodes = SEARCH_LOAD(search->nodes);
+    for (int i = 0; i < helper_count; ++i)
+        nodes += SEARCH_LOAD(helpers[i].search.nodes);
+    return nodes;
+}
+
+/* Only the main thread keeps time, and never stops a search with nothing
+ * to show for it.
+ */
+static void search_poll(struct search_t *search)
+{
+    if (search->id || !search->depth)
+        return;
+
+    if (quit ||
+        (search->limits.nodes &&
+         search_nodes(search) >= search->limits.nodes) ||
+        (timeset && get_time_ms() - search->start >= search->hard))
+        SEARCH_STORE(stopped, 1);
+}
+
+static void print_search_move(unsigned int move)
+{
+    int source, target, piece, promo;
+    DECODE_MOVE(move, &source, &target, &piece, &promo);
+
+    printf(" %s%s", square_to_coord[source], square_to_coord[target]);
+    if (promo != piece)
+        printf("%c", promoted_pieces[promo]);
+}
+
+/* UCI's info line, one per iteration */
+static void report(struct search_t *search)
+{
+    u64 elapsed = get_time_ms() - search->start;
+    int score   = search->score;
+    u64 nodes   = search_nodes(search);
+
+    printf("info depth %d score ", search->depth);
+    if (score > MATE_BOUND)
+        printf("mate %d", (MATE_SCORE - score + 1) / 2);
+    else if (score < -MATE_BOUND)
+        printf("mate %d", -(MATE_SCORE + score) / 2);
+    else
+        printf("cp %d", score);
+    printf(" nodes %llu nps %llu time %llu pv", nodes,
+           (elapsed > 0 ? nodes * 1000 / elapsed : 0ULL), elapsed);
+    for (int i = 0; i < search->pv_length[0]; ++i)
+        print_search_move(search->pv[0][i]);
+    printf("\n");
+    fflush(stdout);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Time                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+/* Shares the clock out evenly over the moves left to the control, plus most
+ * of the increment. That share is the soft limit, checked between
+ * iterations; the hard limit, checked while searching, lets a move run a few
+ * shares over but never into the overhead kept back.
+ */
+static void time_allocate(struct search_t *search, int side)
+{
+    struct search_limits_t *limits = &search->limits;
+
+    search->soft = 0;
+    search->hard = 0;
+
+    if (limits->movetime > 0) {
+        search->hard = limits->movetime;
+        return;
+    }
+    if (limits->time[side] <= 0)
+        return;
+
+    long long left = limits->time[side] - TIME_OVERHEAD;
+    long long inc  = (limits->inc[side] > 0) ? limits->inc[side] : 0;
+    int       togo = (limits->movestogo > 0) ? limits->movestogo
+                                              : TIME_MOVES_TO_GO;
+    if (left < 1)
+        left = 1;
+
+    long long soft = left / togo + inc * 3 / 4;
+    long long hard = soft * TIME_HARD_FACTOR;
+    if (hard > left)
+        hard = left;
+    if (soft > hard)
+        soft = hard;
+
+    search->soft = ( u64 )soft;
+    search->hard = ( u64 )hard;
+}
+
+/* Percent of the soft limit to use, by how many iterations in a row have
+ * come back with the same best move: a move that just changed gets longer
+ * to settle, one that has held for a while is played early.
+ */
+static const int stability_scale[5] = {140, 100, 85, 70, 60};
+
+static inline int time_for_next(struct search_t *search, int stable)
+{
+    if (!search->soft)
+        return 1;
+
+    u64 soft = search->soft * stability_scale[stable < 4 ? stable : 4] / 100;
+    if (soft > search->hard)
+        soft = search->hard;
+
+    return get_time_ms() - search->start < soft;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                 Ordering                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+/* Bands a move is scored into, highest picked first. Quiet moves score their
+ * history, which is kept below ORDER_COUNTER, and captures that lose material
+ * go below them all.
+ */
+#define ORDER_TT      (1 << 30)
+#define ORDER_CAPTURE (1 << 28)
+#define ORDER_KILLER  (1 << 27)
+#define ORDER_COUNTER (1 << 26)
+
+extern const int see_values[6];
+
+/* moves   - the node's legal moves, reordered as they are picked
+ * scores  - each move's band and rank within it
+ * next    - moves before this have been handed out
+ */
+struct picker_t {
+    struct move_list_t *moves;
+    int                 scores[MAX_MOVES];
+    int                 next;
+};
+
+static inline int is_quiet(unsigned int move)
+{
+    return !MOVE_CAPTURE_FLAG(move) &&
+           ((move & MOVE_PROMO) >> 16) == ((move & MOVE_PIECE) >> 12);
+}
+
+/* The quiet move that last refuted the move just played, if any */
+static inline unsigned int *counter_slot(struct search_t *search,
+                                         struct state_t  *state)
+{
+    if (!state->undo_count)
+        return NULL;
+
+    unsigned int last =
+            state->undo[(state->undo_count - 1) & (MAX_UNDO - 1)].move;
+    return &search->counters[(last & MOVE_PIECE) >> 12]
+                            [(last & MOVE_TARGET) >> 6];
+}
+
+/* Scores every move once, nothing is sorted until it is asked for */
+static void picker_init(struct picker_t *picker, struct search_t *search,
+                        struct state_t *state, struct move_list_t *moves,
+                        unsigned int tt_move, int ply)
+{
+    unsigned int *slot    = counter_slot(search, state);
+    unsigned int  counter = slot ? *slot : 0;
+
+    picker->moves = moves;
+    picker->next  = 0;
+
+    for (int i = 0; i < moves->count; ++i) {
+        unsigned int move = moves->moves[i];
+        int         *score = &picker->scores[i];
+        int          source, target, piece, promo;
+        DECODE_MOVE(move, &source, &target, &piece, &promo);
+
+        if (tt_move && tt_pack_move(move) == tt_move) {
+            *score = ORDER_TT;
+        } else if (!is_quiet(move)) {
+            /* most valuable victim, then least valuable attacker; SEE is
+             * only needed when the attacker is worth more than its victim
+             */
+            int victim = MOVE_CAPTURE_FLAG(move)
+                                 ? (MOVE_PASSANT_FLAG(move)
+                                            ? P
+                                            : state->board[target] % 6)
+                                 : P;
+            int rank   = (victim * 8 - piece % 6) * 8 + promo % 6;
+            int losing = see_values[piece % 6] > see_values[victim] &&
+                         see(state, move) < 0;
+            *score     = (losing ? -ORDER_CAPTURE : ORDER_CAPTURE) + rank;
+        } else if (move == search->killers[ply][0]) {
+            *score = ORDER_KILLER + 1;
+        } else if (move == search->killers[ply][1]) {
+            *score = ORDER_KILLER;
+        } else if (move == counter) {
+            *score = ORDER_COUNTER;
+        } else {
+            *score = search->history[piece][target];
+        }
+    }
+}
+
+/* Hands out the best move left, one selection sort step at a time so the
+ * rest of a list that cut off is never ordered. 0 when none are left.
+ */
+static inline unsigned int picker_next(struct picker_t *picker)
+{
+    struct move_list_t *moves = picker->moves;
+    int                 next  = picker->next;
+
+    if (next >= moves->count)
+        return 0;
+
+    int best = next;
+    for (int i = next + 1; i < moves->count; ++i)
+        if (picker->scores[i] > picker->scores[best])
+            best = i;
+
+    unsigned int move    = moves->moves[best];
+    int          score   = picker->scores[best];
+    moves->moves[best]   = moves->moves[next];
+    picker->scores[best] = picker->scores[next];
+    moves->moves[next]   = move;
+    picker->scores[next] = score;
+    ++picker->next;
+
+    return move;
+}
+
+/* Whether the move picker_next() last handed out loses material */
+static inline int picker_losing(struct picker_t *picker)
+{
+    return picker->scores[picker->next - 1] < 0;
+}
+
+static inline void update_quiet(struct search_t *search,
+                                struct state_t *state, unsigned int move,
+                                int depth, int ply)
+{
+    int           piece = (move & MOVE_PIECE) >> 12;
+    int           to    = (move & MOVE_TARGET) >> 6;
+    unsigned int *slot  = counter_slot(search, state);
+
+    if (search->killers[ply][0] != move) {
+        search->killers[ply][1] = search->killers[ply][0];
+        search->killers[ply][0] = move;
+    }
+    if (slot)
+        *slot = move;
+
+    search->history[piece][to] += depth * depth;
+    if (search->history[piece][to] >= ORDER_COUNTER) {
+        for (int p = 0; p < 12; ++p)
+            for (int sq = 0; sq < 64; ++sq)
+                search->history[p][sq] /= 2;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Search                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+/* Biggest swing a capture can make beyond what it takes */
+#define DELTA_MARGIN 200
+
+/* Where a pawn of either side stands one push from promoting */
+#define SEVENTH_RANK_WHITE 0x00FF000000000000ULL
+#define SEVENTH_RANK_BLACK 0x000000000000FF00ULL
+
+/* Captures and promotions only, until the position is quiet enough for its
+ * static score to stand. Captures that cannot lift alpha even with a margin
+ * on top, or that lose material outright, are not searched. In check every
+ * evasion is tried, since standing pat is not an option there.
+ */
+static int quiescence(struct search_t *search, struct state_t *state,
+                      int alpha, int beta, int ply)
+{
+    search->pv_length[ply] = ply;
+
+    SEARCH_STORE(search->nodes, search->nodes + 1);
+    ++search->stats.qnodes;
+    if ((search->nodes & (SEARCH_POLL_NODES - 1)) == 0)
+        search_poll(search);
+    if (SEARCH_LOAD(stopped))
+        return 0;
+    if (ply >= MAX_PLY - 1)
+        return evaluate(state);
+
+    struct move_list_t moves[1];
+
+    int in_check = (get_checkers(state) != 0ULL);
+    int best     = -INF_SCORE;
+    int eval     = 0;
+
+    if (in_check) {
+        generate_moves(state, moves, only_evasions);
+        if (!moves->count)
+            return -MATE_SCORE + ply;
+    } else {
+        eval = evaluate(state);
+        if (eval >= beta)
+            return eval;
+
+        /* a pawn on its seventh can add a promotion to the best capture */
+        int swing = see_values[Q] + DELTA_MARGIN;
+        if (state->bitboards[state->side == white ? P : p] &
+            (state->side == white ? SEVENTH_RANK_WHITE : SEVENTH_RANK_BLACK))
+            swing += see_values[Q] - see_values[P];
+        if (eval + swing <= alpha)
+            return eval;
+
+        if (eval > alpha)
+            alpha = eval;
+        best = eval;
+        generate_moves(state, moves, only_captures);
+    }
+
+    struct picker_t picker;
+    picker_init(&picker, search, state, moves, 0, ply);
+
+    unsigned int move;
+    while ((move = picker_next(&picker))) {
+        if (!in_check) {
+            /* losing captures are picked last, none after this is better */
+            if (picker_losing(&picker))
+                break;
+
+            int target = (move & MOVE_TARGET) >> 6;
+            int promo  = (move & MOVE_PROMO) >> 16;
+            int piece  = (move & MOVE_PIECE) >> 12;
+            int gain   = MOVE_PASSANT_FLAG(move) ? see_values[P]
+                         : state->board[target] >= 0
+                                 ? see_values[state->board[target] % 6]
+                                 : 0;
+            if (promo != piece)
+                gain += see_values[promo % 6] - see_values[P];
+            if (eval + gain + DELTA_MARGIN <= alpha)
+                continue;
+        }
+
+        make_move(state, move, all_moves);
+        int score = -quiescence(search, state, -beta, -alpha, ply + 1);
+        unmake_move(state);
+
+        if (SEARCH_LOAD(stopped))
+            return 0;
+        if (score <= best)
+            continue;
+
+        best = score;
+        if (score <= alpha)
+            continue;
+
+        alpha                = score;
+        search->pv[ply][ply] = move;
+        for (int next = ply + 1; next < search->pv_length[ply + 1]; ++next)
+            search->pv[ply][next] = search->pv[ply + 1][next];
+        search->pv_length[ply] = search->pv_length[ply + 1];
+
+        if (score >= beta)
+            break;
+    }
+
+    return best;
+}
+
+static int negamax(struct search_t *search, struct state_t *state, int alpha,
+                   int beta, int depth, int ply)
+{
+    if (depth <= 0)
+        return quiescence(search, state, alpha, beta, ply);
+
+    search->pv_length[ply] = ply;
+
+    SEARCH_STORE(search->nodes, search->nodes + 1);
+    if ((search->nodes & (SEARCH_POLL_NODES - 1)) == 0)
+        search_poll(search);
+    if (SEARCH_LOAD(stopped))
+        return 0;
+
+    if (ply && (state->fifty >= 100 || is_repetition(state)))
+        return 0;
+    if (ply >= MAX_PLY - 1)
+        return evaluate(state);
+
+    /* a bound is only trusted away from the principal variation, so the
+     * one reported is always walked out in full
+     */
+    int             pv_node = (beta - alpha > 1);
+    unsigned int    tt_move = 0;
+    struct tt_hit_t hit;
+    if (tt_probe(state->hash, &hit)) {
+        tt_move   = hit.move;
+        int score = score_from_tt(hit.score, ply);
+        if (ply && !pv_node && hit.depth >= depth &&
+            (hit.bound == tt_exact ||
+             (hit.bound == tt_lower && score >= beta) ||
+             (hit.bound == tt_upper && score <= alpha)))
+            return score;
+    }
+
+    struct move_list_t moves[1];
+    generate_moves(state, moves, all_moves);
+
+    if (!moves->count)
+        return (state->check != no_check) ? -MATE_SCORE + ply : 0;
+
+    struct picker_t picker;
+    picker_init(&picker, search, state, moves, tt_move, ply);
+
+    int          best      = -INF_SCORE;
+    int          old_alpha = alpha;
+    unsigned int best_move = 0;
+    unsigned int move;
+
+    while ((move = picker_next(&picker))) {
+        make_move(state, move, all_moves);
+        int score = -negamax(search, state, -beta, -alpha, depth - 1, ply + 1);
+        unmake_move(state);
+
+        if (SEARCH_LOAD(stopped))
+            return 0;
+        if (score <= best)
+            continue;
+
+        best = score;
+        if (score <= alpha)
+            continue;
+
+        alpha     = score;
+        best_move = move;
+
+        search->pv[ply][ply] = best_move;
+        for (int next = ply + 1; next < search->pv_length[ply + 1]; ++next)
+            search->pv[ply][next] = search->pv[ply + 1][next];
+        search->pv_length[ply] = search->pv_length[ply + 1];
+
+        if (score >= beta) {
+            search->stats.cutoffs       += 1;
+            search->stats.first_cutoffs += (picker.next == 1);
+            if (is_quiet(best_move))
+                update_quiet(search, state, best_move, depth, ply);
+            break;
+        }
+    }
+
+    int bound = (best >= beta)          ? tt_lower
+                : (alpha > old_alpha) ? tt_exact
+                                      : tt_upper;
+    tt_store(state->hash, tt_pack_move(best_move), score_to_tt(best, ply),
+             depth, bound);
+
+    return best;
+}
+
+/* Helpers skip some depths so they are not all on the same iteration at
+ * once, and fill the table ahead of the main thread instead.
+ */
+/* clang-format off */
+static const int skip_size[20]  = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                   3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+static const int skip_phase[20] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3,
+                                   4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+/* clang-format on */
+
+static inline int skip_depth(int id, int depth)
+{
+    if (!id)
+        return 0;
+    int i = (id - 1) % 20;
+    return ((depth + skip_phase[i]) / skip_size[i]) % 2;
+}
+
+/* An iteration cut short is thrown away, the move played is always the
+ * first of the last complete principal variation.
+ */
+static unsigned int iterate(struct search_t *search, struct state_t *state)
+{
+    struct search_limits_t *limits    = &search->limits;
+    int                     max_depth = (limits->depth > 0 &&
+                                         limits->depth < MAX_PLY)
+                                                ? limits->depth
+                                                : MAX_PLY - 1;
+
+    unsigned int best_move = 0;
+    unsigned int pv[MAX_PLY];
+    int          pv_length = 0;
+    int          stable    = 0;
+
+    for (int depth = 1; depth <= max_depth; ++depth) {
+        if (skip_depth(search->id, depth) && depth < max_depth)
+            continue;
+
+        int score = negamax(search, state, -INF_SCORE, INF_SCORE, depth, 0);
+        if (SEARCH_LOAD(stopped))
+            break;
+
+        search->depth = depth;
+        search->score = score;
+        pv_length     = search->pv_length[0];
+        memcpy(pv, search->pv[0], sizeof(unsigned int) * pv_length);
+        stable = (pv_length && pv[0] == best_move) ? stable + 1 : 0;
+        if (pv_length)
+            best_move = pv[0];
+
+        if (!search->id && !limits->quiet)
+            report(search);
+
+        /* nothing deeper will find a shorter mate */
+        if ((score > MATE_BOUND && MATE_SCORE - score <= depth) ||
+            (score < -MATE_BOUND && MATE_SCORE + score <= depth))
+            break;
+        /* mate or stalemate at the root */
+        if (!pv_length)
+            break;
+        if (!search->id && !time_for_next(search, stable))
+            break;
+    }
+
+    memcpy(search->pv[0], pv, sizeof(unsigned int) * pv_length);
+    search->pv_length[0] = pv_length;
+
+    return best_move;
+}
+
+static void *helper_main(void *arg)
+{
+    struct search_thread_t *helper = arg;
+    iterate(&helper->search, &helper->state);
+    return NULL;
+}
+
+/* Lazy SMP: helpers search the same root on their own copies, sharing
+ * nothing but the transposition table. The main thread's result is the one
+ * played, left in state->current_best_move, and its finishing stops the
+ * helpers.
+ */
+unsigned int search_position(struct state_t *state, struct search_t *search)
+{
+    struct search_limits_t *limits  = &search->limits;
+    int                     threads = limits->threads;
+    if (threads < 1)
+        threads = 1;
+    if (threads > SEARCH_MAX_THREADS)
+        threads = SEARCH_MAX_THREADS;
+
+    if (!tt.buckets)
+        tt_resize(TT_DEFAULT_MB);
+    tt_new_search();
+
+    search->nodes = 0;
+    search->depth = 0;
+    search->score = 0;
+    search->id    = 0;
+    search->start = get_time_ms();
+    time_allocate(search, state->side);
+    memset(search->killers, 0, sizeof(search->killers));
+    memset(search->history, 0, sizeof(search->history));
+    memset(search->counters, 0, sizeof(search->counters));
+    memset(&search->stats, 0, sizeof(search->stats));
+    timeset = (search->hard > 0);
+    SEARCH_STORE(stopped, 0);
+
+    helper_count = 0;
+    if (threads > 1 &&
+        posix_memalign(( void ** )&helpers, 64,
+                       sizeof(struct search_thread_t) * (threads - 1)))
+        helpers = NULL;
+    for (int i = 0; helpers && i < threads - 1; ++i) {
+        struct search_thread_t *helper = &helpers[i];
+        memset(&helper->search, 0, sizeof(helper->search));
+        helper->search.limits       = *limits;
+        helper->search.limits.quiet = 1;
+        helper->search.id           = i + 1;
+        helper->search.start        = search->start;
+        helper->state               = *state;
+        if (pthread_create(&helper->thread, NULL, helper_main, helper))
+            break;
+        ++helper_count;
+    }
+
+    unsigned int best_move = iterate(search, state);
+
+    SEARCH_STORE(stopped, 1);
+    for (int i = 0; i < helper_count; ++i)
+        pthread_join(helpers[i].thread, NULL);
+    /* what is reported covers the helpers' share as well */
+    search->nodes = search_nodes(search);
+    for (int i = 0; i < helper_count; ++i) {
+        search->stats.cutoffs       += helpers[i].search.stats.cutoffs;
+        search->stats.first_cutoffs += helpers[i].search.stats.first_cutoffs;
+        search->stats.qnodes        += helpers[i].search.stats.qnodes;
+    }
+    if (!limits->quiet)
+        printf("info string cutoffs %llu first move %.1f%% qnodes %llu "
+               "(%.1f%%)\n",
+               search->stats.cutoffs,
+               (search->stats.cutoffs ? 100.0 * search->stats.first_cutoffs /
+                                                search->stats.cutoffs
+                                      : 0),
+               search->stats.qnodes,
+               (search->nodes ? 100.0 * search->stats.qnodes / search->nodes
+                              : 0));
+    free(helpers);
+    helpers      = NULL;
+    helper_count = 0;
+
+    state->current_best_move = best_move;
+    timeset                  = 0;
+
+    return best_move;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                   Test                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef _SEARCH_TEST
+#include "fen.h"
+
+struct search_case_t {
+    const char *name;
+    char       *fen;
+    int         depth;
+    const char *move;  /* expected best move, NULL for any */
+    int         score; /* expected score, 0 for any */
+    const char *bait;  /* a move to stay off and score below, NULL for none */
+};
+
+/* clang-format off */
+struct search_case_t search_cases[] = {
+    {"mate in 1",   "6k1/5ppp/8/8/8/8/5PPP/R5K1 w - - 0 1",   4, "a1a8",
+     MATE_SCORE - 1, NULL},
+    {"mate in 2",   "7k/8/8/8/8/8/R7/1R4K1 w - - 0 1",        5, NULL,
+     MATE_SCORE - 3, NULL},
+    {"free queen",  "4k3/8/8/3q4/8/8/3R4/4K3 w - - 0 1",      3, "d2d5",
+     0, NULL},
+    {"horizon",     "4k3/8/2p5/3p4/8/8/8/3QK3 w - - 0 1",     1, NULL, 0,
+     "d1d5"},
+    {"stalemate",   "7k/5Q2/6K1/8/8/8/8/8 b - - 0 1",          3, NULL,
+     0, NULL},
+};
+/* clang-format on */
+
+static int move_is(unsigned int move, const char *expected)
+{
+    char text[6] = {0};
+    int  source, target, piece, promo;
+    DECODE_MOVE(move, &source, &target, &piece, &promo);
+    snprintf(text, sizeof(text), "%s%s%c", square_to_coord[source],
+             square_to_coord[target],
+             (promo != piece ? promoted_pieces[promo] : '\0'));
+    return !strcmp(text, expected);
+}
+
+/* The static eval right after move, for the side playing it: what a search
+ * that missed the reply would score it at.
+ */
+static int bait_score(struct state_t *state, const char *move)
+{
+    struct move_list_t moves[1];
+    struct state_t     after = *state;
+    generate_moves(&after, moves, all_moves);
+    for (int i = 0; i < moves->count; ++i) {
+        if (!move_is(moves->moves[i], move))
+            continue;
+        make_move(&after, moves->moves[i], all_moves);
+        return -tapered_eval(&after);
+    }
+    return -MATE_SCORE;
+}
+
+int main(void)
+{
+    static struct search_t search;
+    struct state_t         state  = {0};
+    int                    failed = 0;
+    int count = sizeof(search_cases) / sizeof(search_cases[0]);
+
+    init_all();
+
+    for (int i = 0; i < count; ++i) {
+        struct search_case_t *test = &search_cases[i];
+
+        printf("Testing %s...\n", test->name);
+        parse_fen(test->fen, &state);
+        tt_clear();
+        search        = (struct search_t){0};
+        search.limits = (struct search_limits_t){.depth = test->depth};
+        unsigned int move = search_position(&state, &search);
+
+        if ((test->move && !move_is(move, test->move)) ||
+            (test->score && search.score != test->score) ||
+            (test->bait && (move_is(move, test->bait) ||
+                            search.score >= bait_score(&state, test->bait))) ||
+            (!test->move && !test->score && !test->bait && move)) {
+            printf("Test %d failed: %s\n", i + 1, test->name);
+            ++failed;
+            continue;
+        }
+        printf("Test %d passed\n", i + 1);
+    }
+
+    printf("Testing node limit...\n");
+    parse_fen(STATE1, &state);
+    search        = (struct search_t){0};
+    search.limits = (struct search_limits_t){.nodes = 50000};
+    if (!search_position(&state, &search) ||
+        search.nodes >= 50000 + SEARCH_POLL_NODES) {
+        printf("Test %d failed: %llu nodes\n", count + 1, search.nodes);
+        ++failed;
+    } else {
+        printf("Test %d passed\n", count + 1);
+    }
+
+    printf("Testing helper threads...\n");
+    parse_fen(search_cases[1].fen, &state);
+    tt_clear();
+    search        = (struct search_t){0};
+    search.limits = (struct search_limits_t){.depth = 5, .threads = 4};
+    search_position(&state, &search);
+    if (search.score != search_cases[1].score) {
+        printf("Test %d failed: score %d\n", count + 2, search.score);
+        ++failed;
+    } else {
+        printf("Test %d passed\n", count + 2);
+    }
+
+    printf("Testing time limit...\n");
+    parse_fen(STATE3, &state);
+    search        = (struct search_t){0};
+    search.limits = (struct search_limits_t){.movetime = 200};
+    u64 start     = get_time_ms();
+    u64 elapsed   = (search_position(&state, &search), get_time_ms() - start);
+    if (!state.current_best_move || elapsed > 200 + 100) {
+        printf("Test %d failed: %llu ms\n", count + 3, elapsed);
+        ++failed;
+    } else {
+        printf("Test %d passed\n", count + 3);
+    }
+
+    /* sudden death and a clock about to flag on a small increment: each
+     * move must come back inside its hard limit, and that inside the clock
+     */
+    struct search_limits_t clocks[2] = {
+            {.time = {1000, 1000}},
+            {.time = {50, 50}, .inc = {10, 10}},
+    };
+    for (int i = 0; i < 2; ++i) {
+        printf("Testing clock %d+%d...\n", clocks[i].time[white],
+               clocks[i].inc[white]);
+        parse_fen(STATE3, &state);
+        search        = (struct search_t){0};
+        search.limits = clocks[i];
+        start         = get_time_ms();
+        elapsed = (search_position(&state, &search), get_time_ms() - start);
+        if (!state.current_best_move || !search.hard ||
+            search.hard > ( u64 )clocks[i].time[white] ||
+            elapsed > search.hard + 20) {
+            printf("Test %d failed: %llu ms of %llu\n", count + 4 + i,
+                   elapsed, search.hard);
+            ++failed;
+        } else {
+            printf("Test %d passed\n", count + 4 + i);
+        }
+    }
+
+    return (failed ? 1 : 0);
+}
+#endif /* _SEARCH_TEST */
+
+#ifdef _SEARCH_SCALING
+#include <unistd.h>
+
+#include "fen.h"
+
+#define SCALING_DEPTH 7
+
+/* Time to a fixed depth is what Lazy SMP is judged on, NPS alone flatters
+ * it: helpers search plenty of nodes the main thread never needed.
+ */
+static void scaling(const char *name, char *fen, int *counts, int count_size)
+{
+    static struct search_t search;
+    struct state_t         state = {0};
+    double                 base_ms = 0, base_nps = 0;
+
+    printf("%s depth %d\n", name, SCALING_DEPTH);
+    printf("%8s %10s %12s %12s %8s %8s  %s\n", "threads", "ms", "nodes",
+           "NPS", "ttd", "nps", "move");
+    for (int i = 0; i < count_size; ++i) {
+        parse_fen(fen, &state);
+        tt_clear();
+        search        = (struct search_t){0};
+        search.limits = (struct search_limits_t){
+                .depth = SCALING_DEPTH, .quiet = 1, .threads = counts[i]};
+
+        u64          start = get_time_ms();
+        unsigned int move  = search_position(&state, &search);
+        int          ms    = ( int )(get_time_ms() - start);
+        double       nps   = (ms > 0 ? search.nodes * 1e3 / ms : 0);
+        if (i == 0) {
+            base_ms  = ms;
+            base_nps = nps;
+        }
+
+        printf("%8d %10d %12llu %12.0f %7.2fx %7.2fx ", counts[i], ms,
+               search.nodes, nps, (ms > 0 ? base_ms / ms : 0),
+               (base_nps > 0 ? nps / base_nps : 0));
+        print_search_move(move);
+        printf("\n");
+    }
+    puts("");
+}
+
+int main(int argc, char **argv)
+{
+    init_all();
+    tt_resize(argc > 1 ? strtoul(argv[1], NULL, 10) : 64);
+
+    long cores     = sysconf(_SC_NPROCESSORS_ONLN);
+    int  counts[6] = {1, 2, 4, 8, 16};
+    int  size      = 5;
+    if (cores != 1 && cores != 2 && cores != 4 && cores != 8 && cores != 16)
+        counts[size++] = ( int )cores;
+
+    printf("SEARCH: %ld cores online, %zu MB table\n\n", cores,
+           tt.bytes / (1024 * 1024));
+    scaling("KIWIPETE", STATE1, counts, size);
+    scaling("MIDGAME", STATE3, counts, size);
+
+    return 0;
+}
+#endif /* _SEARCH_SCALING */
+
+/* vim: ft=c ts=4 sts=4 sw=4 ai et cin */
@@ -0,0 +1,129 @@
+/* search.h
+ * Copyright 2025 h5law <dev@h5law.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "types.h"
+
+#define MAX_PLY 64
+
+/* Scores are centipawns for the side to move. A mate scores MATE_SCORE less
+ * the plies it takes, anything past MATE_BOUND is a mate.
+ */
+#define INF_SCORE  32000
+#define MATE_SCORE 31000
+#define MATE_BOUND (MATE_SCORE - MAX_PLY)
+
+/* Nodes between looks at the clock and the node limit */
+#define SEARCH_POLL_NODES 2048
+
+#define SEARCH_MAX_THREADS 256
+
+/* Milliseconds kept back from the clock for moving and sending the move */
+#define TIME_OVERHEAD 30
+/* Moves the remaining clock is shared over when the control does not say */
+#define TIME_MOVES_TO_GO 30
+/* How far past its share a move may run when the best move is in doubt */
+#define TIME_HARD_FACTOR 4
+
+/* What stops a search, 0 leaves a limit off
+ * depth     - last iteration to run, MAX_PLY - 1 at most
+ * nodes     - nodes to visit, counted over every thread
+ * movetime  - milliseconds to think, all of them
+ * time      - each side's clock in milliseconds, by colour
+ * inc       - each side's increment per move
+ * movestogo - moves until the clock is topped up, 0 for sudden death
+ * quiet     - no report after each iteration
+ * threads   - threads searching the root together, 1 when left at 0
+ */
+struct search_limits_t {
+    int depth;
+    u64 nodes;
+    int movetime;
+    int time[2];
+    int inc[2];
+    int movestogo;
+    int quiet;
+    int threads;
+};
+
+/* Move ordering at nodes that cut off, and how much of the tree is spent
+ * settling captures
+ * cutoffs       - beta cutoffs
+ * first_cutoffs - cutoffs by the first move picked, ideally nearly all
+ * qnodes        - quiescence nodes, also counted in the search's nodes
+ */
+struct search_stats_t {
+    u64 cutoffs;
+    u64 first_cutoffs;
+    u64 qnodes;
+};
+
+/* One thread's search, limits filled in by the caller
+ * nodes     - positions this thread visited
+ * start     - get_time_ms() when it began
+ * soft      - ms after start not to begin another iteration, 0 for none
+ * hard      - ms after start to stop, 0 for none
+ * depth     - deepest iteration completed
+ * score     - that iteration's score
+ * id        - 0 for the thread that keeps time and reports, helpers after
+ * pv        - triangular principal variation table, row 0 is the root's
+ * pv_length - where each row of pv ends
+ * killers   - the last two quiet moves to cut off at each ply
+ * history   - quiet cutoffs by piece and target square, weighted by depth
+ * counters  - the quiet move that last cut off each reply, by the piece
+ *             and target square of the move replied to
+ * stats     - how well the moves were ordered
+ *
+ * Aligned so no two threads' tables ever share a cache line.
+ */
+struct search_t {
+    struct search_limits_t limits;
+    u64                    nodes;
+    u64                    start;
+    u64                    soft;
+    u64                    hard;
+    int                    depth;
+    int                    score;
+    int                    id;
+    unsigned int           pv[MAX_PLY][MAX_PLY];
+    int                    pv_length[MAX_PLY];
+    unsigned int           killers[MAX_PLY][2];
+    int                    history[12][64];
+    unsigned int           counters[12][64];
+    struct search_stats_t  stats;
+} __attribute__((aligned(64)));
+
+unsigned int search_position(struct state_t *state, struct search_t *search);
+
+#endif /* SEARCH_H */
+
+/* vim: ft=c ts=4 sts=4 sw=4 ai et cin */
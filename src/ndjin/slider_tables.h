@@ -0,0 +1,69 @@
+/* slider_tables.h
+ * Copyright 2025 h5law <dev@h5law.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SLIDER_TABLES_H
+#define SLIDER_TABLES_H
+
+#include "types.h"
+
+/* Slider attack lookup for one square
+ * attacks - this square's slice of slider_attacks[]
+ * mask    - relevant occupancy (board edges excluded)
+ * magic   - multiplier hashing masked occupancy into the slice (magic build)
+ * shift   - 64 - index bits of the slice (magic build)
+ */
+struct magic_t {
+    const u64 *attacks;
+    u64        mask;
+    u64        magic;
+    int        shift;
+};
+
+/* Sum of 2^bits over bishop_bits[] / rook_bits[], kept in step with the
+ * magic_finder output; rerun `make slider_tables` after changing either.
+ * Squares get back to back slices that never overlap. PEXT indexes by the full
+ * mask, so both backends share these sizes only while the bits are the mask
+ * sizes; denser magics will need a PEXT size of their own.
+ */
+#define BISHOP_ATTACKS_SIZE 5248
+#define ROOK_ATTACKS_SIZE   102400
+#define SLIDER_ATTACKS_SIZE (BISHOP_ATTACKS_SIZE + ROOK_ATTACKS_SIZE)
+
+/* Generated into slider_tables.c by `make slider_tables` */
+extern const struct magic_t bishop_table[64];
+extern const struct magic_t rook_table[64];
+extern const u64            slider_attacks[SLIDER_ATTACKS_SIZE];
+extern const u64            slider_tables_checksum;
+extern const u64            between_squares[64][64];
+extern const u64            line_squares[64][64];
+
+#endif /* SLIDER_TABLES_H */
+
+/* vim: ft=c ts=4 sts=4 sw=4 ai et cin */
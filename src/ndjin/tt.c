@@ -0,0 +1,282 @@
+/* tt.c
+ * Copyright 2025 h5law <dev@h5law.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "types.h"
+#include "tt.h"
+
+#define TT_HUGE_PAGE (2 * 1024 * 1024)
+
+#define TT_MOVE(data)  (( unsigned int )((data) & 0xFFFF))
+#define TT_SCORE(data) (( int )( short )(((data) >> 16) & 0xFFFF))
+#define TT_DEPTH(data) (( int )(((data) >> 32) & 0xFF))
+#define TT_BOUND(data) (( int )(((data) >> 40) & 0x3))
+#define TT_AGE(data)   (( int )(((data) >> 42) & 0x3F))
+
+#define TT_LOAD(x)     __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define TT_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+struct tt_t                     tt = {NULL, 0, 0, 0};
+_Thread_local struct tt_stats_t tt_stats;
+
+/* Rounds down to a power of two buckets so a key indexes with one mask.
+ * Not safe while a search is running, returns -1 and leaves the table
+ * empty when the memory cannot be had.
+ */
+int tt_resize(size_t megabytes)
+{
+    size_t bytes   = megabytes * 1024 * 1024;
+    size_t buckets = 1;
+    while (buckets * 2 * sizeof(struct tt_bucket_t) <= bytes)
+        buckets *= 2;
+    bytes = buckets * sizeof(struct tt_bucket_t);
+
+    tt_free();
+    if (!megabytes)
+        return 0;
+
+    size_t align = (bytes >= TT_HUGE_PAGE) ? TT_HUGE_PAGE : 64;
+    void  *table = NULL;
+    if (posix_memalign(&table, align, bytes))
+        return -1;
+#ifdef MADV_HUGEPAGE
+    if (align == TT_HUGE_PAGE)
+        madvise(table, bytes, MADV_HUGEPAGE);
+#endif
+
+    tt.buckets = table;
+    tt.mask    = buckets - 1;
+    tt.bytes   = bytes;
+    tt_clear();
+
+    return 0;
+}
+
+void tt_clear(void)
+{
+    if (tt.buckets)
+        memset(tt.buckets, 0, tt.bytes);
+    tt.age = 0;
+}
+
+void tt_free(void)
+{
+    free(tt.buckets);
+    tt.buckets = NULL;
+    tt.mask    = 0;
+    tt.bytes   = 0;
+}
+
+/* Entries from older searches are the first to go */
+void tt_new_search(void)
+{
+    tt.age = (tt.age + 1) & 0x3F;
+}
+
+int tt_probe(u64 key, struct tt_hit_t *hit)
+{
+    ++tt_stats.probes;
+    if (!tt.buckets)
+        return 0;
+
+    struct tt_bucket_t *bucket = &tt.buckets[key & tt.mask];
+    for (int i = 0; i < TT_BUCKET_SIZE; ++i) {
+        u64 data = TT_LOAD(bucket->entries[i].data);
+        if ((TT_LOAD(bucket->entries[i].key) ^ data) != key ||
+            TT_BOUND(data) == tt_none)
+            continue;
+
+        hit->move  = TT_MOVE(data);
+        hit->score = TT_SCORE(data);
+        hit->depth = TT_DEPTH(data);
+        hit->bound = TT_BOUND(data);
+        ++tt_stats.hits;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Takes over the entry already holding this key, else the emptiest, oldest,
+ * shallowest one in the bucket. A store without a move keeps the old one.
+ */
+void tt_store(u64 key, unsigned int move, int score, int depth, int bound)
+{
+    ++tt_stats.stores;
+    if (!tt.buckets)
+        return;
+
+    struct tt_bucket_t *bucket  = &tt.buckets[key & tt.mask];
+    struct tt_entry_t  *replace = NULL;
+    u64                 old     = 0;
+    int                 same    = 0;
+    int                 worst   = 0x7FFFFFFF;
+
+    for (int i = 0; i < TT_BUCKET_SIZE; ++i) {
+        struct tt_entry_t *entry = &bucket->entries[i];
+        u64                data  = TT_LOAD(entry->data);
+
+        if ((TT_LOAD(entry->key) ^ data) == key) {
+            replace = entry;
+            old     = data;
+            same    = 1;
+            break;
+        }
+
+        int value = TT_BOUND(data) == tt_none
+                            ? -0x10000
+                            : TT_DEPTH(data) -
+                                      8 * ((tt.age - TT_AGE(data)) & 0x3F);
+        if (value < worst) {
+            replace = entry;
+            old     = data;
+            worst   = value;
+        }
+    }
+
+    if (same) {
+        if (!move)
+            move = TT_MOVE(old);
+    } else if (TT_BOUND(old) != tt_none && TT_AGE(old) == tt.age) {
+        ++tt_stats.overwrites;
+    }
+
+    if (score > 32767)
+        score = 32767;
+    if (score < -32767)
+        score = -32767;
+    if (depth < 0)
+        depth = 0;
+    if (depth > 255)
+        depth = 255;
+
+    u64 data = ( u64 )(move & 0xFFFF) | (( u64 )( unsigned short )score << 16) |
+               (( u64 )depth << 32) | (( u64 )(bound & 0x3) << 40) |
+               (( u64 )tt.age << 42);
+    TT_STORE(replace->key, key ^ data);
+    TT_STORE(replace->data, data);
+}
+
+/* Per mille of the first 1000 buckets' entries stored by this search */
+int tt_hashfull(void)
+{
+    if (!tt.buckets)
+        return 0;
+
+    int used    = 0;
+    int buckets = (tt.mask + 1 < 1000) ? ( int )tt.mask + 1 : 1000;
+    for (int i = 0; i < buckets; ++i)
+        for (int j = 0; j < TT_BUCKET_SIZE; ++j) {
+            u64 data = TT_LOAD(tt.buckets[i].entries[j].data);
+            used += TT_BOUND(data) != tt_none && TT_AGE(data) == tt.age;
+        }
+
+    return used * 1000 / (buckets * TT_BUCKET_SIZE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                                  Bench                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef _TT_BENCH
+#include <stdio.h>
+#include <time.h>
+
+#include "bb.h"
+#include "fen.h"
+
+#define BENCH_DEPTH 4
+
+/* A perft walk that only expands a node the table has not seen at this
+ * depth, the way a search would skip a transposition
+ */
+static void walk(struct state_t *state, int depth)
+{
+    struct tt_hit_t hit;
+    if (tt_probe(state->hash, &hit) && hit.depth >= depth) {
+        tt_best_move(state); /* counts a move that does not fit as bad */
+        return;
+    }
+
+    struct move_list_t moves[1];
+    generate_moves(state, moves, all_moves);
+
+    unsigned int first = 0;
+    for (int i = 0; depth && i < moves->count; ++i) {
+        if (!make_move(state, moves->moves[i], all_moves))
+            continue;
+        if (!first)
+            first = moves->moves[i];
+        walk(state, depth - 1);
+        unmake_move(state);
+    }
+
+    tt_store(state->hash, tt_pack_move(first), 0, depth, tt_exact);
+}
+
+int main(int argc, char **argv)
+{
+    init_all();
+
+    struct state_t state = {0};
+    size_t         sizes[] = {1, 4, 16, 64};
+
+    printf("TT: %d entries of %d bytes per bucket, perft walk depth %d\n\n",
+           TT_BUCKET_SIZE, ( int )sizeof(struct tt_entry_t), BENCH_DEPTH);
+    printf("%8s %12s %8s %12s %10s %8s %8s\n", "MB", "probes", "hit %",
+           "overwrites", "bad moves", "full", "ms");
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        if (tt_resize(sizes[i])) {
+            printf("%8zu allocation failed\n", sizes[i]);
+            continue;
+        }
+        tt_new_search();
+        memset(&tt_stats, 0, sizeof(tt_stats));
+        parse_fen(STATE1, &state);
+
+        u64 start = get_time_ms();
+        walk(&state, BENCH_DEPTH);
+        int ms = ( int )(get_time_ms() - start);
+
+        printf("%8zu %12llu %8.2f %12llu %10llu %8d %8d\n", sizes[i],
+               tt_stats.probes, 100.0 * tt_stats.hits / tt_stats.probes,
+               tt_stats.overwrites, tt_stats.bad_moves, tt_hashfull(), ms);
+    }
+
+    tt_free();
+    return 0;
+}
+#endif /* _TT_BENCH */
+
+/* vim: ft=c ts=4 sts=4 sw=4 ai et cin */
@@ -0,0 +1,114 @@
+/* tt.h
+ * Copyright 2025 h5law <dev@h5law.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TT_H
+#define TT_H
+
+#include <stddef.h>
+
+#include "types.h"
+
+/* Transposition table bounds, tt_none marks an empty entry */
+enum { tt_none, tt_upper, tt_lower, tt_exact };
+
+#define TT_BUCKET_SIZE 4
+#define TT_DEFAULT_MB  16
+
+/* Entry data binary schema
+ * bits  0-15 move, see tt_pack_move()
+ * bits 16-31 score
+ * bits 32-39 depth
+ * bits 40-41 bound
+ * bits 42-47 age of the search that stored it
+ *
+ * The key is stored XORed with the data, so an entry torn by two threads
+ * writing it at once fails the key check instead of handing out a mix of
+ * both positions.
+ */
+struct tt_entry_t {
+    u64 key;
+    u64 data;
+};
+
+struct tt_bucket_t {
+    struct tt_entry_t entries[TT_BUCKET_SIZE];
+} __attribute__((aligned(64)));
+
+struct tt_t {
+    struct tt_bucket_t *buckets;
+    u64                 mask;
+    size_t              bytes;
+    int                 age;
+};
+
+/* What a probe found, move is still packed (see tt_best_move()) */
+struct tt_hit_t {
+    unsigned int move;
+    int          score;
+    int          depth;
+    int          bound;
+};
+
+/* Per thread, so counting never contends
+ * probes     - tt_probe() calls
+ * hits       - probes whose key checked out
+ * stores     - tt_store() calls
+ * overwrites - stores evicting another position from the current search
+ * bad_moves  - hits whose move was not playable, a key collision
+ */
+struct tt_stats_t {
+    u64 probes;
+    u64 hits;
+    u64 stores;
+    u64 overwrites;
+    u64 bad_moves;
+};
+
+extern struct tt_t                     tt;
+extern _Thread_local struct tt_stats_t tt_stats;
+
+int  tt_resize(size_t megabytes);
+void tt_clear(void);
+void tt_free(void);
+void tt_new_search(void);
+int  tt_probe(u64 key, struct tt_hit_t *hit);
+void tt_store(u64 key, unsigned int move, int score, int depth, int bound);
+int  tt_hashfull(void);
+
+/* source, target and promoted piece, which pick out one move in a position */
+static inline unsigned int tt_pack_move(unsigned int move)
+{
+    return (move & (MOVE_SOURCE | MOVE_TARGET)) |
+           ((move & MOVE_PROMO) >> 4);
+}
+
+#endif /* TT_H */
+
+/* vim: ft=c ts=4 sts=4 sw=4 ai et cin */
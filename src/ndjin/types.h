@@ -77,14 +77,21 @@ enum { bishop, rook };
  */
 enum { WKCK = 0x1, WKCQ = 0x2, BKCK = 0x4, BKCQ = 0x8 };
 
+/* No legal position has more than 218 moves */
+#define MAX_MOVES 256
+
+struct move_list_t {
+    unsigned int moves[MAX_MOVES];
+    int          count;
+};
+
+/* The moves of a move_list_t leaving one square, see square_moves(). No
+ * single piece has more than 27 moves (a pawn promoting has 12).
+ */
 struct square_moves_t {
     unsigned int moves[32];
     int          count;
 };
-struct move_list_t {
-    struct square_moves_t squares[64];
-    int                   count;
-};
 
 /* Move binary schema
  * 0000 0000 0000 0000 0011 1111 source
@@ -114,14 +121,14 @@ struct move_list_t {
 #define ENCODE_MOVE(source, target, piece, promo, capture, dpush, passant,     \
                     castle)                                                    \
     (0U | (                                                                    \
-        (source & 63) |                                                        \
-        ((target & 63) << 6) |                                                 \
-        ((piece & 15) << 12) |                                                 \
-        ((promo & 15) << 16) |                                                 \
-        (capture << 20) |                                                      \
-        (dpush << 21) |                                                        \
-        (passant << 22) |                                                      \
-        (castle << 23)))
+        ((source) & 63) |                                                      \
+        (((target) & 63) << 6) |                                               \
+        (((piece) & 15) << 12) |                                               \
+        (((promo) & 15) << 16) |                                               \
+        ((capture) << 20) |                                                    \
+        ((dpush) << 21) |                                                      \
+        ((passant) << 22) |                                                    \
+        ((castle) << 23)))
 
 #define DECODE_MOVE(move, source, target, piece, promo)                        \
     do {                                                                       \
@@ -132,58 +139,62 @@ struct move_list_t {
     } while(0)
 /* clang-format on */
 
-struct state_t {
-    int          side;
-    int          check;
+/* What make_move() overwrites and unmake_move() cannot work out from the
+ * move itself
+ * move      - the move made
+ * captured  - piece taken (on the target square, or behind it en-passant),
+ *             -1 for a quiet move
+ * enpassant - en-passant square before the move
+ * castle    - castling rights before the move
+ * fifty     - half move clock before the move
+ * hash      - zobrist key before the move
+ */
+struct undo_t {
+    unsigned int move;
+    int          captured;
     int          enpassant;
     int          castle;
-    int          ply;
     int          fifty;
-    int          fullmoves;
-    u64          bitboards[12];
-    u64          positions[3];
-    unsigned int current_best_move;
+    u64          hash;
 };
 
-enum { all_moves, only_captures };
+/* The undo stack holds the game played so far and, on top of it, whatever
+ * a search or perft has made. apply_move() keeps the game part down to the
+ * moves since the last irreversible one (never more than GAME_HISTORY), all
+ * repetition detection needs, so MAX_UNDO only has to cover that plus the
+ * deepest search. Debug builds stop on a push past it.
+ */
+#define GAME_HISTORY 100
+#define MAX_UNDO     256
 
-#define BOARD_BACKUP(state1, state2)                                           \
-    do {                                                                       \
-        memcpy((( struct state_t * )state2)->bitboards,                        \
-               (( struct state_t * )state1)->bitboards, 96);                   \
-        memcpy((( struct state_t * )state2)->positions,                        \
-               (( struct state_t * )state1)->positions, 24);                   \
-        (( struct state_t * )state2)->side =                                   \
-                (( struct state_t * )state1)->side;                            \
-        (( struct state_t * )state2)->enpassant =                              \
-                (( struct state_t * )state1)->enpassant;                       \
-        (( struct state_t * )state2)->castle =                                 \
-                (( struct state_t * )state1)->castle;                          \
-        (( struct state_t * )state2)->ply = (( struct state_t * )state1)->ply; \
-        (( struct state_t * )state2)->fifty =                                  \
-                (( struct state_t * )state1)->fifty;                           \
-        (( struct state_t * )state2)->fullmoves =                              \
-                (( struct state_t * )state1)->fullmoves;                       \
-    } while (0)
-
-#define BOARD_RESTORE(state2, state1)                                          \
-    do {                                                                       \
-        memcpy((( struct state_t * )state1)->bitboards,                        \
-               (( struct state_t * )state2)->bitboards, 96);                   \
-        memcpy((( struct state_t * )state1)->positions,                        \
-               (( struct state_t * )state2)->positions, 24);                   \
-        (( struct state_t * )state1)->side =                                   \
-                (( struct state_t * )state2)->side;                            \
-        (( struct state_t * )state1)->enpassant =                              \
-                (( struct state_t * )state2)->enpassant;                       \
-        (( struct state_t * )state1)->castle =                                 \
-                (( struct state_t * )state2)->castle;                          \
-        (( struct state_t * )state1)->ply = (( struct state_t * )state2)->ply; \
-        (( struct state_t * )state1)->fifty =                                  \
-                (( struct state_t * )state2)->fifty;                           \
-        (( struct state_t * )state1)->fullmoves =                              \
-                (( struct state_t * )state2)->fullmoves;                       \
-    } while (0)
+struct state_t {
+    int           side;
+    int           check;
+    int           enpassant;
+    int           castle;
+    int           ply;
+    int           fifty;
+    int           fullmoves;
+    u64           bitboards[12];
+    u64           positions[3];
+    int           board[64];   /* piece on each square, -1 when empty */
+    u64           hash;        /* zobrist key, see zobrist.h */
+    int           material[2]; /* centipawns on the board, see eval.h */
+    int           phase;       /* PHASE_TOTAL down to 0 in a pawn ending */
+    int           pst_mg;      /* piece-square midgame score for white */
+    int           pst_eg;      /* piece-square endgame score for white */
+    unsigned int  current_best_move;
+    int           undo_count;
+    struct undo_t undo[MAX_UNDO];
+};
+
+/* Move generation modes, also make_move()'s move_flag
+ * all_moves     - every legal move
+ * only_captures - captures (en passant included) and every promotion
+ * only_quiets   - everything only_captures leaves out, castling included
+ * only_evasions - every legal move when in check, nothing otherwise
+ */
+enum { all_moves, only_captures, only_quiets, only_evasions };
 
 #endif /* TYPES_H */
 
@@ -0,0 +1,85 @@
+/* zobrist.c
+ * Copyright 2025 h5law <dev@h5law.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "types.h"
+#include "bitops.h"
+#include "zobrist.h"
+
+u64 piece_keys[12][64];
+u64 enpassant_keys[64];
+u64 castle_keys[16];
+u64 side_key;
+
+/* splitmix64, seeded with a constant so the keys never change */
+static u64 zobrist_next(u64 *seed)
+{
+    u64 z = (*seed += 0x9E3779B97F4A7C15ULL);
+    z     = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z     = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void init_zobrist(void)
+{
+    u64 seed = 0x6E646A696E5A4B59ULL;
+
+    for (int piece = P; piece <= k; ++piece)
+        for (int sq = a1; sq <= h8; ++sq)
+            piece_keys[piece][sq] = zobrist_next(&seed);
+    for (int sq = a1; sq <= h8; ++sq)
+        enpassant_keys[sq] = zobrist_next(&seed);
+    for (int i = 0; i < 16; ++i)
+        castle_keys[i] = zobrist_next(&seed);
+    side_key = zobrist_next(&seed);
+}
+
+/* From scratch, make_move() keeps state->hash up to date incrementally */
+u64 generate_hash(struct state_t *state)
+{
+    u64 hash = 0ULL;
+
+    for (int piece = P; piece <= k; ++piece) {
+        u64 bitboard = state->bitboards[piece];
+        while (bitboard) {
+            hash ^= piece_keys[piece][bit_lsb(bitboard)];
+            pop_lsb(bitboard);
+        }
+    }
+
+    if (state->enpassant != no_sq)
+        hash ^= enpassant_keys[state->enpassant];
+    hash ^= castle_keys[state->castle & 15];
+    if (state->side == black)
+        hash ^= side_key;
+
+    return hash;
+}
+
+/* vim: ft=c ts=4 sts=4 sw=4 ai et cin */
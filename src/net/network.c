@@ -45,6 +45,7 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 
+#include <ndjin/search.h>
 #include <ndjin/types.h>
 
 #include "network.h"
@@ -670,6 +671,8 @@ void *sending_thread(void *connection)
     time_t     tslp          = 0;
     game_msg_n previous_move = 0;
     ssize_t    recv_len      = 0;
+
+    static struct search_t search;
     while (1) {
         if (time(NULL) - tslp >= ping_interval) {
             send_header((( struct p2p * )connection)->send_socket, NDJIN_PING);
@@ -708,8 +711,12 @@ void *sending_thread(void *connection)
                 break;
             case CURRENT_MOVE_NUMBER:
                 DEBUG("send_move(): sending best current move\n");
-                unsigned int move      = apply_move(state, 0x00000000);
-                game_msg_n   next_move = NEW_INIT_96(
+                search.limits = (struct search_limits_t){
+                        .movetime = MOVE_TIME, .quiet = 1};
+                unsigned int move = search_position(state, &search);
+                if (move)
+                    apply_move(state, move);
+                game_msg_n next_move = NEW_INIT_96(
                         move, prev_move, CURRENT_MOVE_NUMBER, prev_counter + 1);
                 send_move((( struct p2p * )connection)->send_socket, next_move);
                 break;
@@ -54,6 +54,11 @@
 #define PING_INTERVAL 30
 #endif /* PING_INTERVAL */
 
+/* milliseconds the engine thinks before sending its own move */
+#ifndef MOVE_TIME
+#define MOVE_TIME 1000
+#endif /* MOVE_TIME */
+
 #define HANDSHAKE_NUMBER     0x1E015A23
 #define HANDSHAKE_ACK_NUMBER 0x1E025A23
 #define HANDSHAKE_GREET      0xBAD05157